@@ -0,0 +1,758 @@
+/*
+ * Copyright (c) 2012 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <AssertMacros.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mach/mach_time.h>
+#include <CoreFoundation/CFRuntime.h>
+#include <IOKit/hid/IOHIDKeys.h>
+#include <asl.h>
+#include "IOHIDLibPrivate.h"
+#include "IOHIDElement.h"
+#include "IOHIDValue.h"
+
+/*
+ * Capture file layout.  Every record is 8 byte aligned so that a replay can
+ * walk the file in place after mapping it:
+ *
+ *      IOHIDCaptureHeader
+ *      IOHIDCaptureElementRecord, elementCount times
+ *      IOHIDCaptureValueRecord + bytes (padded), valueCount times
+ *
+ * The element table is written in full when the capture opens, so that a
+ * file cut short still describes every element its values refer to.
+ * Values, and elements their parent collection, refer to elements by table
+ * index.  Only valueCount changes on close.
+ */
+#define kIOHIDCaptureMagic          0x48494463  // 'HIDc'
+#define kIOHIDCaptureVersion        3
+#define kIOHIDCaptureBufferSize     (64 * 1024)
+#define kIOHIDCaptureAlign(x)       (((x) + 7) & ~7ULL)
+
+typedef struct _IOHIDCaptureHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    timebaseNumer;
+    uint32_t    timebaseDenom;
+    uint64_t    elementOffset;
+    uint32_t    elementCount;
+    uint32_t    reserved;
+    uint64_t    valueOffset;
+    uint64_t    valueCount;
+} IOHIDCaptureHeader;
+
+typedef struct _IOHIDCaptureValueRecord {
+    uint64_t    timestamp;
+    uint32_t    elementIndex;
+    uint32_t    length;
+} IOHIDCaptureValueRecord;
+
+typedef struct _IOHIDCaptureElementRecord {
+    uint32_t    cookie;
+    uint32_t    type;
+    uint32_t    collectionType;
+    uint32_t    usagePage;
+    uint32_t    usage;
+    uint32_t    flags;
+    uint32_t    reportID;
+    uint32_t    reportSize;
+    uint32_t    reportCount;
+    uint32_t    size;
+    uint32_t    unit;
+    uint32_t    unitExponent;
+    int32_t     logicalMin;
+    int32_t     logicalMax;
+    int32_t     physicalMin;
+    int32_t     physicalMax;
+    uint32_t    parent;     // table index, or kIOHIDElementTableIndexNone
+    uint32_t    reserved;
+} IOHIDCaptureElementRecord;
+
+static IOHIDCaptureRef      __IOHIDCaptureCreate(
+                                    CFAllocatorRef          allocator,
+                                    CFAllocatorContext *    context __unused);
+static void                 __IOHIDCaptureRelease( CFTypeRef object );
+static void                 __IOHIDCaptureRegister(void);
+static IOReturn             __IOHIDCaptureWriteElements(IOHIDCaptureRef capture);
+static IOHIDReplayRef       __IOHIDReplayCreate(
+                                    CFAllocatorRef          allocator,
+                                    CFAllocatorContext *    context __unused);
+static void                 __IOHIDReplayRelease( CFTypeRef object );
+static void                 __IOHIDReplayRegister(void);
+static IOReturn             __IOHIDReplayCreateElements(IOHIDReplayRef replay);
+static void                 __IOHIDReplaySetNumber(
+                                    CFMutableDictionaryRef  dictionary,
+                                    CFStringRef             key,
+                                    int64_t                 value);
+static uint64_t             __IOHIDReplayScaleTime(
+                                    uint64_t                time,
+                                    uint32_t                numer,
+                                    uint32_t                denom);
+static uint64_t             __IOHIDReplayConvertTime(
+                                    IOHIDReplayRef          replay,
+                                    uint64_t                delta);
+
+typedef struct __IOHIDCapture
+{
+    CFRuntimeBase                   cfBase;   // base CFType information
+
+    FILE *                          file;
+    IOHIDCaptureHeader              header;
+
+    CFMutableArrayRef               elements;
+    CFMutableDictionaryRef          elementIndices;
+} __IOHIDCapture, *__IOHIDCaptureRef;
+
+typedef struct __IOHIDReplay
+{
+    CFRuntimeBase                   cfBase;   // base CFType information
+
+    const uint8_t *                 map;
+    size_t                          mapSize;
+    const IOHIDCaptureHeader *      header;
+    mach_timebase_info_data_t       timebase;
+
+    CFMutableArrayRef               elements;
+    IOHIDElementTable *             elementTable;
+} __IOHIDReplay, *__IOHIDReplayRef;
+
+static const CFRuntimeClass __IOHIDCaptureClass = {
+    0,                      // version
+    "IOHIDCapture",         // className
+    NULL,                   // init
+    NULL,                   // copy
+    __IOHIDCaptureRelease,  // finalize
+    NULL,                   // equal
+    NULL,                   // hash
+    NULL,                   // copyFormattingDesc
+    NULL,
+    NULL,
+    NULL
+};
+
+static const CFRuntimeClass __IOHIDReplayClass = {
+    0,                      // version
+    "IOHIDReplay",          // className
+    NULL,                   // init
+    NULL,                   // copy
+    __IOHIDReplayRelease,   // finalize
+    NULL,                   // equal
+    NULL,                   // hash
+    NULL,                   // copyFormattingDesc
+    NULL,
+    NULL,
+    NULL
+};
+
+static pthread_once_t   __captureTypeInit       = PTHREAD_ONCE_INIT;
+static CFTypeID         __kIOHIDCaptureTypeID   = _kCFRuntimeNotATypeID;
+static pthread_once_t   __replayTypeInit        = PTHREAD_ONCE_INIT;
+static CFTypeID         __kIOHIDReplayTypeID    = _kCFRuntimeNotATypeID;
+
+//------------------------------------------------------------------------------
+// __IOHIDCaptureRegister
+//------------------------------------------------------------------------------
+void __IOHIDCaptureRegister(void)
+{
+    __kIOHIDCaptureTypeID = _CFRuntimeRegisterClass(&__IOHIDCaptureClass);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDCaptureCreate
+//------------------------------------------------------------------------------
+IOHIDCaptureRef __IOHIDCaptureCreate(
+                                CFAllocatorRef              allocator,
+                                CFAllocatorContext *        context __unused)
+{
+    IOHIDCaptureRef capture = NULL;
+    void *          offset  = NULL;
+    uint32_t        size;
+
+    /* allocate service */
+    size    = sizeof(__IOHIDCapture) - sizeof(CFRuntimeBase);
+    capture = (IOHIDCaptureRef)_CFRuntimeCreateInstance(allocator, _IOHIDCaptureGetTypeID(), size, NULL);
+
+    if (!capture)
+        return NULL;
+
+    offset = capture;
+    bzero(offset + sizeof(CFRuntimeBase), size);
+
+    return capture;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDCaptureRelease
+//------------------------------------------------------------------------------
+void __IOHIDCaptureRelease( CFTypeRef object )
+{
+    IOHIDCaptureRef capture = (IOHIDCaptureRef)object;
+
+    _IOHIDCaptureClose(capture);
+
+    if ( capture->elementIndices ) {
+        CFRelease(capture->elementIndices);
+        capture->elementIndices = NULL;
+    }
+
+    if ( capture->elements ) {
+        CFRelease(capture->elements);
+        capture->elements = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDCaptureGetTypeID
+//------------------------------------------------------------------------------
+CFTypeID _IOHIDCaptureGetTypeID(void)
+{
+    if ( _kCFRuntimeNotATypeID == __kIOHIDCaptureTypeID )
+        pthread_once(&__captureTypeInit, __IOHIDCaptureRegister);
+
+    return __kIOHIDCaptureTypeID;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDCaptureCreate
+//------------------------------------------------------------------------------
+IOHIDCaptureRef _IOHIDCaptureCreate(
+                                CFAllocatorRef              allocator,
+                                const char *                path,
+                                CFArrayRef                  elements)
+{
+    IOHIDCaptureRef             capture = NULL;
+    IOHIDElementRef             element;
+    mach_timebase_info_data_t   timebase;
+    uintptr_t                   index;
+    CFIndex                     count;
+
+    if ( !path || !elements )
+        return NULL;
+
+    capture = __IOHIDCaptureCreate(allocator, NULL);
+
+    if ( !capture )
+        return NULL;
+
+    capture->elements       = CFArrayCreateMutable(allocator, 0, &kCFTypeArrayCallBacks);
+    capture->elementIndices = CFDictionaryCreateMutable(allocator, 0, NULL, NULL);
+    capture->file           = fopen(path, "w+");
+
+    require(capture->elements && capture->elementIndices && capture->file, error);
+
+    // Indices are stored off by one so that a missing key reads as zero
+    count = CFArrayGetCount(elements);
+    for ( index=0; index<(uintptr_t)count; index++ ) {
+        element = (IOHIDElementRef)CFArrayGetValueAtIndex(elements, index);
+        if ( CFDictionaryGetValue(capture->elementIndices, element) )
+            continue;
+
+        CFArrayAppendValue(capture->elements, element);
+        CFDictionarySetValue(capture->elementIndices, element, (const void *)(uintptr_t)CFArrayGetCount(capture->elements));
+    }
+
+    // Values arrive one at a time on the run loop; let stdio batch the writes
+    setvbuf(capture->file, NULL, _IOFBF, kIOHIDCaptureBufferSize);
+
+    mach_timebase_info(&timebase);
+
+    capture->header.magic           = kIOHIDCaptureMagic;
+    capture->header.version         = kIOHIDCaptureVersion;
+    capture->header.timebaseNumer   = timebase.numer;
+    capture->header.timebaseDenom   = timebase.denom;
+    capture->header.elementOffset   = sizeof(IOHIDCaptureHeader);
+    capture->header.elementCount    = (uint32_t)CFArrayGetCount(capture->elements);
+    capture->header.valueOffset     = capture->header.elementOffset + 
+                                      capture->header.elementCount * sizeof(IOHIDCaptureElementRecord);
+
+    // The header is rewritten with the final value count on close
+    require(fwrite(&capture->header, sizeof(IOHIDCaptureHeader), 1, capture->file) == 1, error);
+    require_noerr(__IOHIDCaptureWriteElements(capture), error);
+
+    return capture;
+
+error:
+    _IOHIDLog(ASL_LEVEL_ERR, "%s unable to create capture file %s\n", __func__, path);
+    CFRelease(capture);
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDCaptureRecordValue
+//------------------------------------------------------------------------------
+IOReturn _IOHIDCaptureRecordValue(
+                                IOHIDCaptureRef             capture,
+                                IOHIDValueRef               value)
+{
+    static const uint8_t    padding[8]  = {0};
+    IOHIDElementRef         element     = NULL;
+    IOHIDCaptureValueRecord record;
+    uintptr_t               index;
+    size_t                  padLength;
+
+    if ( !capture->file )
+        return kIOReturnNotOpen;
+
+    if ( !value )
+        return kIOReturnBadArgument;
+
+    element = IOHIDValueGetElement(value);
+
+    // The table was written when the capture opened and can't grow
+    index = (uintptr_t)CFDictionaryGetValue(capture->elementIndices, element);
+    if ( !index )
+        return kIOReturnNotFound;
+
+    record.timestamp    = IOHIDValueGetTimeStamp(value);
+    record.elementIndex = (uint32_t)(index - 1);
+    record.length       = (uint32_t)IOHIDValueGetLength(value);
+    padLength           = kIOHIDCaptureAlign(record.length) - record.length;
+
+    if ( (fwrite(&record, sizeof(record), 1, capture->file) != 1) ||
+         (fwrite(IOHIDValueGetBytePtr(value), 1, record.length, capture->file) != record.length) ||
+         (fwrite(padding, 1, padLength, capture->file) != padLength) )
+        return kIOReturnIOError;
+
+    capture->header.valueCount++;
+
+    return kIOReturnSuccess;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDCaptureValueCallback
+//------------------------------------------------------------------------------
+void _IOHIDCaptureValueCallback(
+                                void *                      context,
+                                IOReturn                    result,
+                                void *                      sender __unused,
+                                IOHIDValueRef               value)
+{
+    IOHIDCaptureRef capture = (IOHIDCaptureRef)context;
+
+    if ( !capture ) {
+        _IOHIDLog(ASL_LEVEL_WARNING, "%s called with a null context\n", __func__);
+        return;
+    }
+
+    if ( result != kIOReturnSuccess )
+        return;
+
+    _IOHIDCaptureRecordValue(capture, value);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDCaptureWriteElements
+//------------------------------------------------------------------------------
+IOReturn __IOHIDCaptureWriteElements(IOHIDCaptureRef capture)
+{
+    IOHIDCaptureElementRecord   record;
+    IOHIDElementRef             element;
+    IOHIDElementRef             parent;
+    uintptr_t                   parentIndex;
+    CFIndex                     index, count;
+
+    count = CFArrayGetCount(capture->elements);
+
+    for ( index=0; index<count; index++ ) {
+        element = (IOHIDElementRef)CFArrayGetValueAtIndex(capture->elements, index);
+
+        bzero(&record, sizeof(record));
+        record.cookie           = (uint32_t)IOHIDElementGetCookie(element);
+        record.type             = IOHIDElementGetType(element);
+        record.collectionType   = IOHIDElementGetCollectionType(element);
+        record.usagePage        = IOHIDElementGetUsagePage(element);
+        record.usage            = IOHIDElementGetUsage(element);
+        record.flags            = _IOHIDElementGetFlags(element);
+        record.reportID         = IOHIDElementGetReportID(element);
+        record.reportSize       = IOHIDElementGetReportSize(element);
+        record.reportCount      = IOHIDElementGetReportCount(element);
+        record.size             = (uint32_t)(_IOHIDElementGetLength(element) * 8);
+        record.unit             = IOHIDElementGetUnit(element);
+        record.unitExponent     = IOHIDElementGetUnitExponent(element);
+        record.logicalMin       = (int32_t)IOHIDElementGetLogicalMin(element);
+        record.logicalMax       = (int32_t)IOHIDElementGetLogicalMax(element);
+        record.physicalMin      = (int32_t)IOHIDElementGetPhysicalMin(element);
+        record.physicalMax      = (int32_t)IOHIDElementGetPhysicalMax(element);
+
+        // A parent that wasn't captured leaves the element at the top level
+        parent      = IOHIDElementGetParent(element);
+        parentIndex = parent ? (uintptr_t)CFDictionaryGetValue(capture->elementIndices, parent) : 0;
+        record.parent           = parentIndex ? (uint32_t)(parentIndex - 1) : kIOHIDElementTableIndexNone;
+
+        if ( fwrite(&record, sizeof(record), 1, capture->file) != 1 )
+            return kIOReturnIOError;
+    }
+
+    return kIOReturnSuccess;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDCaptureClose
+//------------------------------------------------------------------------------
+IOReturn _IOHIDCaptureClose(IOHIDCaptureRef capture)
+{
+    IOReturn ret = kIOReturnSuccess;
+
+    if ( !capture->file )
+        return kIOReturnNotOpen;
+
+    if ( (fseeko(capture->file, 0, SEEK_SET) != 0) ||
+         (fwrite(&capture->header, sizeof(IOHIDCaptureHeader), 1, capture->file) != 1) )
+        ret = kIOReturnIOError;
+
+    if ( (fclose(capture->file) != 0) && (ret == kIOReturnSuccess) )
+        ret = kIOReturnIOError;
+
+    capture->file = NULL;
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplayRegister
+//------------------------------------------------------------------------------
+void __IOHIDReplayRegister(void)
+{
+    __kIOHIDReplayTypeID = _CFRuntimeRegisterClass(&__IOHIDReplayClass);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplayCreate
+//------------------------------------------------------------------------------
+IOHIDReplayRef __IOHIDReplayCreate(
+                                CFAllocatorRef              allocator,
+                                CFAllocatorContext *        context __unused)
+{
+    IOHIDReplayRef  replay  = NULL;
+    void *          offset  = NULL;
+    uint32_t        size;
+
+    /* allocate service */
+    size    = sizeof(__IOHIDReplay) - sizeof(CFRuntimeBase);
+    replay  = (IOHIDReplayRef)_CFRuntimeCreateInstance(allocator, _IOHIDReplayGetTypeID(), size, NULL);
+
+    if (!replay)
+        return NULL;
+
+    offset = replay;
+    bzero(offset + sizeof(CFRuntimeBase), size);
+
+    return replay;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplayRelease
+//------------------------------------------------------------------------------
+void __IOHIDReplayRelease( CFTypeRef object )
+{
+    IOHIDReplayRef replay = (IOHIDReplayRef)object;
+
+    if ( replay->elementTable ) {
+        _IOHIDElementTableRelease(replay->elementTable);
+        replay->elementTable = NULL;
+    }
+
+    if ( replay->elements ) {
+        CFRelease(replay->elements);
+        replay->elements = NULL;
+    }
+
+    if ( replay->map ) {
+        munmap((void *)replay->map, replay->mapSize);
+        replay->map     = NULL;
+        replay->header  = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDReplayGetTypeID
+//------------------------------------------------------------------------------
+CFTypeID _IOHIDReplayGetTypeID(void)
+{
+    if ( _kCFRuntimeNotATypeID == __kIOHIDReplayTypeID )
+        pthread_once(&__replayTypeInit, __IOHIDReplayRegister);
+
+    return __kIOHIDReplayTypeID;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplaySetNumber
+//------------------------------------------------------------------------------
+void __IOHIDReplaySetNumber(
+                                CFMutableDictionaryRef      dictionary,
+                                CFStringRef                 key,
+                                int64_t                     value)
+{
+    CFNumberRef number = CFNumberCreate(CFGetAllocator(dictionary), kCFNumberSInt64Type, &value);
+
+    if ( !number )
+        return;
+
+    CFDictionarySetValue(dictionary, key, number);
+    CFRelease(number);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplayCreateElements
+//------------------------------------------------------------------------------
+IOReturn __IOHIDReplayCreateElements(IOHIDReplayRef replay)
+{
+    CFAllocatorRef                      allocator   = CFGetAllocator(replay);
+    const IOHIDCaptureElementRecord *   records;
+    const IOHIDCaptureElementRecord *   record;
+    CFMutableDictionaryRef              properties;
+    IOHIDElementRef                     element;
+    uint32_t                            index;
+
+    replay->elements = CFArrayCreateMutable(allocator, replay->header->elementCount, &kCFTypeArrayCallBacks);
+    if ( !replay->elements )
+        return kIOReturnNoMemory;
+
+    records = (const IOHIDCaptureElementRecord *)(replay->map + replay->header->elementOffset);
+
+    for ( index=0; index<replay->header->elementCount; index++ ) {
+        record = &records[index];
+
+        if ( (record->parent != kIOHIDElementTableIndexNone) && (record->parent >= replay->header->elementCount) )
+            return kIOReturnBadMedia;
+
+        properties = CFDictionaryCreateMutable(allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        if ( !properties )
+            return kIOReturnNoMemory;
+
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementCookieKey), record->cookie);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementTypeKey), record->type);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementCollectionTypeKey), record->collectionType);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementUsagePageKey), record->usagePage);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementUsageKey), record->usage);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementFlagsKey), record->flags);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementReportIDKey), record->reportID);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementReportSizeKey), record->reportSize);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementReportCountKey), record->reportCount);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementSizeKey), record->size);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementUnitKey), record->unit);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementUnitExponentKey), record->unitExponent);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementMinKey), record->logicalMin);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementMaxKey), record->logicalMax);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementScaledMinKey), record->physicalMin);
+        __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementScaledMaxKey), record->physicalMax);
+
+        if ( record->parent != kIOHIDElementTableIndexNone )
+            __IOHIDReplaySetNumber(properties, CFSTR(kIOHIDElementCollectionCookieKey), records[record->parent].cookie);
+
+        element = IOHIDElementCreateWithDictionary(allocator, properties);
+        CFRelease(properties);
+
+        if ( !element )
+            return kIOReturnNoMemory;
+
+        CFArrayAppendValue(replay->elements, element);
+        CFRelease(element);
+    }
+
+    // Link the elements by their parent cookies so that IOHIDElementGetParent
+    // and IOHIDElementGetChildren walk the recorded hierarchy
+    if ( replay->header->elementCount ) {
+        replay->elementTable = _IOHIDElementTableCreate(replay->elements);
+        if ( !replay->elementTable )
+            return kIOReturnNoMemory;
+    }
+
+    return kIOReturnSuccess;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDReplayCreate
+//------------------------------------------------------------------------------
+IOHIDReplayRef _IOHIDReplayCreate(
+                                CFAllocatorRef              allocator,
+                                const char *                path)
+{
+    IOHIDReplayRef              replay  = NULL;
+    const IOHIDCaptureHeader *  header  = NULL;
+    struct stat                 fileStat;
+    int                         fd      = -1;
+    void *                      map;
+
+    if ( !path )
+        return NULL;
+
+    replay = __IOHIDReplayCreate(allocator, NULL);
+
+    if ( !replay )
+        return NULL;
+
+    fd = open(path, O_RDONLY);
+    require(fd >= 0, error);
+    require(fstat(fd, &fileStat) == 0, error);
+    require((size_t)fileStat.st_size >= sizeof(IOHIDCaptureHeader), error);
+
+    map = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    require(map != MAP_FAILED, error);
+
+    close(fd);
+    fd = -1;
+
+    replay->map     = (const uint8_t *)map;
+    replay->mapSize = (size_t)fileStat.st_size;
+    header          = (const IOHIDCaptureHeader *)replay->map;
+
+    require(header->magic == kIOHIDCaptureMagic, error);
+    require(header->version == kIOHIDCaptureVersion, error);
+    require(header->timebaseNumer && header->timebaseDenom, error);
+    require(header->elementOffset >= sizeof(IOHIDCaptureHeader), error);
+    require(header->elementOffset <= replay->mapSize, error);
+    require((replay->mapSize - header->elementOffset) / sizeof(IOHIDCaptureElementRecord) >= header->elementCount, error);
+    require(header->valueOffset >= header->elementOffset + header->elementCount * sizeof(IOHIDCaptureElementRecord), error);
+    require(header->valueOffset <= replay->mapSize, error);
+
+    replay->header = header;
+    mach_timebase_info(&replay->timebase);
+
+    require_noerr(__IOHIDReplayCreateElements(replay), error);
+
+    return replay;
+
+error:
+    _IOHIDLog(ASL_LEVEL_ERR, "%s unable to open capture file %s\n", __func__, path);
+    if ( fd >= 0 )
+        close(fd);
+    CFRelease(replay);
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDReplayGetElements
+//------------------------------------------------------------------------------
+CFArrayRef _IOHIDReplayGetElements(IOHIDReplayRef replay)
+{
+    return replay->elements;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDReplayGetValueCount
+//------------------------------------------------------------------------------
+CFIndex _IOHIDReplayGetValueCount(IOHIDReplayRef replay)
+{
+    return (CFIndex)replay->header->valueCount;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplayScaleTime
+//------------------------------------------------------------------------------
+uint64_t __IOHIDReplayScaleTime(
+                                uint64_t                    time,
+                                uint32_t                    numer,
+                                uint32_t                    denom)
+{
+    // Split so that time * numer can't overflow; the remainder term stays
+    // below denom * numer, which fits in 64 bits
+    return (time / denom) * numer + (time % denom) * numer / denom;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDReplayConvertTime
+//------------------------------------------------------------------------------
+uint64_t __IOHIDReplayConvertTime(
+                                IOHIDReplayRef              replay,
+                                uint64_t                    delta)
+{
+    const IOHIDCaptureHeader * header = replay->header;
+
+    // Recorded ticks -> nanoseconds -> local ticks, skipped on the same machine
+    if ( (header->timebaseNumer == replay->timebase.numer) &&
+         (header->timebaseDenom == replay->timebase.denom) )
+        return delta;
+
+    delta = __IOHIDReplayScaleTime(delta, header->timebaseNumer, header->timebaseDenom);
+
+    return __IOHIDReplayScaleTime(delta, replay->timebase.denom, replay->timebase.numer);
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDReplayRun
+//------------------------------------------------------------------------------
+IOReturn _IOHIDReplayRun(
+                                IOHIDReplayRef              replay,
+                                IOOptionBits                options,
+                                IOHIDValueCallback          callback,
+                                void *                      context)
+{
+    CFAllocatorRef                  allocator   = CFGetAllocator(replay);
+    const uint8_t *                 cursor      = replay->map + replay->header->valueOffset;
+    const uint8_t *                 end         = replay->map + replay->mapSize;
+    const IOHIDCaptureValueRecord * record;
+    IOHIDElementRef                 element;
+    IOHIDValueRef                   value;
+    uint64_t                        firstTimestamp  = 0;
+    uint64_t                        startTime       = mach_absolute_time();
+    uint64_t                        timestamp;
+    uint64_t                        index;
+
+    if ( !callback )
+        return kIOReturnBadArgument;
+
+    for ( index=0; index<replay->header->valueCount; index++ ) {
+        if ( (size_t)(end - cursor) < sizeof(IOHIDCaptureValueRecord) )
+            return kIOReturnUnderrun;
+
+        record  = (const IOHIDCaptureValueRecord *)cursor;
+        cursor += sizeof(IOHIDCaptureValueRecord);
+
+        if ( (record->elementIndex >= replay->header->elementCount) ||
+             ((uint64_t)(end - cursor) < kIOHIDCaptureAlign(record->length)) )
+            return kIOReturnUnderrun;
+
+        if ( index == 0 )
+            firstTimestamp = record->timestamp;
+
+        if ( !(options & kIOHIDReplayOptionsMaximumSpeed) && (record->timestamp > firstTimestamp) ) {
+            timestamp = startTime + __IOHIDReplayConvertTime(replay, record->timestamp - firstTimestamp);
+            mach_wait_until(timestamp);
+        }
+
+        // Restamp by default so latency is measured against the replay itself
+        if ( options & kIOHIDReplayOptionsPreserveTimeStamps )
+            timestamp = record->timestamp;
+        else
+            timestamp = mach_absolute_time();
+
+        element = (IOHIDElementRef)CFArrayGetValueAtIndex(replay->elements, record->elementIndex);
+        value   = IOHIDValueCreateWithBytes(allocator, element, timestamp, cursor, record->length);
+        cursor += kIOHIDCaptureAlign(record->length);
+
+        if ( !value )
+            continue;
+
+        (*callback)(context, kIOReturnSuccess, replay, value);
+
+        CFRelease(value);
+    }
+
+    return kIOReturnSuccess;
+}
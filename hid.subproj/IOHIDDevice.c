@@ -32,6 +32,7 @@
 #include <IOKit/hid/IOHIDKeys.h>
 #include <asl.h>
 #include <AssertMacros.h>
+#include <libkern/OSAtomic.h>
 #include "IOHIDDevicePlugIn.h"
 #include "IOHIDDevice.h"
 #include "IOHIDQueue.h"
@@ -87,6 +88,14 @@ static void             __IOHIDDeviceTransactionCallback(
                                     void *                  context, 
                                     IOReturn                result, 
                                     void *                  sender);
+static void             __IOHIDDeviceSetStatisticsEnabled(
+                                    IOHIDDeviceRef          device,
+                                    Boolean                 enable);
+static void             __IOHIDDeviceDetachElement(
+                                    const void *            value,
+                                    void *                  context);
+static void             __IOHIDDeviceInvalidateElementTable(
+                                    IOHIDDeviceRef          device);
 
 //------------------------------------------------------------------------------
 typedef struct __IOHIDDeviceCallbackInfo
@@ -130,6 +139,7 @@ typedef struct __IOHIDDevice
     IOCFPlugInInterface **          plugInInterface;
     CFMutableDictionaryRef          properties;
     CFMutableSetRef                 elements;
+    IOHIDElementTable *             elementTable;
     CFStringRef                     rootKey;
     CFStringRef                     UUIDKey;
     IONotificationPortRef           notificationPort;
@@ -148,6 +158,15 @@ typedef struct __IOHIDDevice
     CFMutableArrayRef               removalCallbackArray;
     CFMutableArrayRef               reportCallbackArray;
     CFMutableArrayRef               inputCallbackArray;
+    
+    // Opt-in input statistics.  NULL unless kIOHIDDeviceStatisticsKey is set,
+    // so the dispatch paths only pay for a pointer test when disabled.  It is
+    // swapped in and out atomically and read once per dispatch; the storage
+    // behind it is only freed with the device, since a dispatch on another
+    // thread may still be recording into it.
+    IOHIDStatistics * volatile      statistics;
+    IOHIDStatistics *               statisticsStorage;
+    CFMutableArrayRef               statisticsSnapshots;
 } __IOHIDDevice, *__IOHIDDeviceRef;
 
 static const CFRuntimeClass __IOHIDDeviceClass = {
@@ -217,6 +236,12 @@ void __IOHIDDeviceRelease( CFTypeRef object )
     }
     
     CFRELEASE_IF_NOT_NULL(device->properties);
+    __IOHIDDeviceInvalidateElementTable(device);
+    
+    // Elements only point weakly back at the device, and may outlive it
+    if ( device->elements )
+        CFSetApplyFunction(device->elements, __IOHIDDeviceDetachElement, NULL);
+    
     CFRELEASE_IF_NOT_NULL(device->elements);
     CFRELEASE_IF_NOT_NULL(device->rootKey);
     
@@ -224,6 +249,13 @@ void __IOHIDDeviceRelease( CFTypeRef object )
     CFRELEASE_IF_NOT_NULL(device->inputCallbackArray);
     CFRELEASE_IF_NOT_NULL(device->reportCallbackArray);
     
+    CFRELEASE_IF_NOT_NULL(device->statisticsSnapshots);
+    device->statistics = NULL;
+    if ( device->statisticsStorage ) {
+        free(device->statisticsStorage);
+        device->statisticsStorage = NULL;
+    }
+    
     if ( device->deviceInterface ) {
         (*device->deviceInterface)->Release(device->deviceInterface);
         device->deviceInterface = NULL;
@@ -365,7 +397,15 @@ IOReturn IOHIDDeviceOpen(
                                 IOHIDDeviceRef                  device, 
                                 IOOptionBits                    options)
 {
-    return (*device->deviceInterface)->open(device->deviceInterface, options);
+    IOReturn ret;
+    
+    ret = (*device->deviceInterface)->open(device->deviceInterface, options);
+    
+    // The plug-in may only publish the full element set once it is open
+    if ( ret == kIOReturnSuccess )
+        __IOHIDDeviceInvalidateElementTable(device);
+        
+    return ret;
 }
 
 //------------------------------------------------------------------------------
@@ -390,8 +430,26 @@ Boolean IOHIDDeviceConformsTo(
                                 uint32_t                        usagePage,
                                 uint32_t                        usage)
 {
-    Boolean                 doesConform = FALSE;
-    CFMutableDictionaryRef  matching    = NULL;
+    Boolean                     doesConform = FALSE;
+    CFMutableDictionaryRef      matching    = NULL;
+    const IOHIDElementTable *   table       = _IOHIDDeviceGetElementTable(device);
+    
+    if ( table ) {
+        const IOHIDElementTableEntry *  entry;
+        uint32_t                        index;
+        
+        for ( index=0; index<table->count; index++ ) {
+            entry = &table->entries[index];
+            
+            if ( entry->type == kIOHIDElementTypeCollection &&
+                 entry->usagePage == usagePage && entry->usage == usage &&
+                 (entry->collectionType == kIOHIDElementCollectionTypePhysical ||
+                  entry->collectionType == kIOHIDElementCollectionTypeApplication) )
+                return TRUE;
+        }
+        
+        return FALSE;
+    }
     
     matching = CFDictionaryCreateMutable(kCFAllocatorDefault, 4, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
     if (matching) {
@@ -449,6 +507,25 @@ CFTypeRef IOHIDDeviceGetProperty(
     CFTypeRef   property = NULL;
     IOReturn    ret;
     
+    if ( CFEqual(key, CFSTR(kIOHIDDeviceStatisticsKey)) ) {
+        CFDictionaryRef snapshot = _IOHIDDeviceCopyStatistics(device);
+        
+        if ( !snapshot )
+            return NULL;
+        
+        // Under the Get rule an earlier snapshot may still be in use, so
+        // every one handed out is kept until the device is released
+        if ( !device->statisticsSnapshots )
+            device->statisticsSnapshots = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+        
+        if ( device->statisticsSnapshots )
+            CFArrayAppendValue(device->statisticsSnapshots, snapshot);
+        
+        CFRelease(snapshot);
+        
+        return device->statisticsSnapshots ? snapshot : NULL;
+    }
+    
     ret = (*device->deviceInterface)->getProperty(
                                             device->deviceInterface,
                                             key, 
@@ -474,6 +551,12 @@ Boolean IOHIDDeviceSetProperty(
                                 CFStringRef                     key,
                                 CFTypeRef                       property)
 {
+    // Statistics are collected in user space and never reach the plugin
+    if ( CFEqual(key, CFSTR(kIOHIDDeviceStatisticsKey)) ) {
+        __IOHIDDeviceSetStatisticsEnabled(device, property == kCFBooleanTrue);
+        return TRUE;
+    }
+    
     if (!device->properties) {
         device->properties = CFDictionaryCreateMutable(kCFAllocatorDefault, 
                                                         0,
@@ -493,6 +576,96 @@ Boolean IOHIDDeviceSetProperty(
                                                    property) == kIOReturnSuccess;
 }
 
+//------------------------------------------------------------------------------
+// __IOHIDDeviceSetStatisticsEnabled
+//------------------------------------------------------------------------------
+void __IOHIDDeviceSetStatisticsEnabled(
+                                IOHIDDeviceRef                  device,
+                                Boolean                         enable)
+{
+    // Dispatch may be running on another thread, so the pointer is only
+    // ever swapped atomically and the storage is reused rather than freed.
+    // A dispatch that read the pointer just before a disable may still
+    // count one more value into it.
+    if ( enable && !device->statistics ) {
+        if ( device->statisticsStorage )
+            _IOHIDStatisticsReset(device->statisticsStorage);
+        else
+            device->statisticsStorage = _IOHIDStatisticsCreate();
+        
+        if ( device->statisticsStorage )
+            OSAtomicCompareAndSwapPtrBarrier(NULL, device->statisticsStorage, (void * volatile *)&device->statistics);
+    }
+    else if ( !enable && device->statistics ) {
+        OSAtomicCompareAndSwapPtrBarrier(device->statisticsStorage, NULL, (void * volatile *)&device->statistics);
+    }
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDDeviceDetachElement
+//------------------------------------------------------------------------------
+void __IOHIDDeviceDetachElement(const void * value, void * context __unused)
+{
+    _IOHIDElementSetDevice((IOHIDElementRef)value, NULL);
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDDeviceGetElementTable
+//------------------------------------------------------------------------------
+const IOHIDElementTable * _IOHIDDeviceGetElementTable(
+                                IOHIDDeviceRef                  device)
+{
+    CFArrayRef elements;
+    
+    if ( device->elementTable )
+        return device->elementTable;
+    
+    // Rebuilt after open and whenever a new element turns up.  An empty set
+    // is not cached, so a device queried before it is open tries again.
+    elements = IOHIDDeviceCopyMatchingElements(device, NULL, 0);
+    if ( elements ) {
+        if ( CFArrayGetCount(elements) )
+            device->elementTable = _IOHIDElementTableCreate(elements);
+        CFRelease(elements);
+    }
+    
+    return device->elementTable;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDDeviceInvalidateElementTable
+//------------------------------------------------------------------------------
+void __IOHIDDeviceInvalidateElementTable(IOHIDDeviceRef device)
+{
+    if ( device->elementTable ) {
+        _IOHIDElementTableRelease(device->elementTable);
+        device->elementTable = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDDeviceGetStatistics
+//------------------------------------------------------------------------------
+const IOHIDStatistics * _IOHIDDeviceGetStatistics(
+                                IOHIDDeviceRef                  device)
+{
+    return device->statistics;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDDeviceCopyStatistics
+//------------------------------------------------------------------------------
+CFDictionaryRef _IOHIDDeviceCopyStatistics(
+                                IOHIDDeviceRef                  device)
+{
+    const IOHIDStatistics * statistics = device->statistics;
+    
+    if ( !statistics )
+        return NULL;
+        
+    return _IOHIDStatisticsCopyDictionary(statistics, 0);
+}
+
 //------------------------------------------------------------------------------
 // IOHIDDeviceCopyMatchingElements
 //------------------------------------------------------------------------------
@@ -530,6 +703,7 @@ CFArrayRef IOHIDDeviceCopyMatchingElements(
                                                         &kCFTypeSetCallBacks))) {
                 if (!CFSetContainsValue(device->elements, element)) {
                     CFSetSetValue(device->elements, element);
+                    __IOHIDDeviceInvalidateElementTable(device);
                     if (device->loadProperties) {
                         __IOHIDElementLoadProperties(element);
                     }
@@ -1281,14 +1455,26 @@ void __IOHIDDeviceInputElementValueCallback(
     IOHIDDeviceRef  device  = (IOHIDDeviceRef)context;
     IOHIDQueueRef   queue   = (IOHIDQueueRef)sender;
     IOHIDValueRef   value   = NULL;
+    IOHIDStatistics * statistics;
+    
+    if ( queue != device->queue )
+        return;
+    
+    statistics = device->statistics;
     
-    if ( (queue != device->queue) || (kIOReturnSuccess != result) )
+    if ( kIOReturnSuccess != result ) {
+        if ( statistics )
+            _IOHIDStatisticsRecordDrop(statistics);
         return;
+    }
     
     CFRetain(device);
 
     // Drain the queue and dispatch the values
     while ( (value = IOHIDQueueCopyNextValue(queue)) ) {
+        if ( statistics )
+            _IOHIDStatisticsRecordValue(statistics, value);
+            
         if ( device->inputCallbackArray ) {
             CFIndex index = 0;
             CFIndex count = CFArrayGetCount(device->inputCallbackArray);
@@ -1432,6 +1618,14 @@ void __IOHIDDeviceReportCallbackRegistered(void *                  context,
     if (!device || !device->reportCallbackArray)
         return;
     
+    IOHIDStatistics * statistics = device->statistics;
+    if ( statistics ) {
+        if ( result == kIOReturnSuccess )
+            _IOHIDStatisticsRecordReport(statistics);
+        else
+            _IOHIDStatisticsRecordDrop(statistics);
+    }
+    
     CFRetain(device);
 
     CFIndex index = 0;
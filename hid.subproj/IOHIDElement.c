@@ -51,6 +51,21 @@ static void                 _IOHIDElementDetach(
                                     Boolean                 propagate);
 static void                 __IOHIDElementApplyCalibration(
                                     IOHIDElementRef element);
+static Boolean              __IOHIDElementGetDictionaryNumber(
+                                    CFDictionaryRef         dictionary,
+                                    CFStringRef             key,
+                                    int64_t *               pValue);
+static void                 __IOHIDElementSetDictionaryFlag(
+                                    CFDictionaryRef         dictionary,
+                                    CFStringRef             key,
+                                    uint32_t                mask,
+                                    Boolean                 setWhenTrue,
+                                    uint32_t *              pFlags);
+static const IOHIDElementTable * __IOHIDElementGetTable(
+                                    IOHIDElementRef         element);
+static int                  __IOHIDElementTableCompareCookies(
+                                    const void *            entry1,
+                                    const void *            entry2);
 
 typedef struct __IOHIDElement
 {
@@ -67,6 +82,8 @@ typedef struct __IOHIDElement
     CFArrayRef                      childElements;
     IOHIDElementRef                 parentElement;
     IOHIDElementRef                 originalElement;
+    const IOHIDElementTable *       table;      // owned by the device, not retained
+    uint32_t                        tableIndex;
     IOHIDCalibrationInfo *          calibrationPtr;
     CFMutableDictionaryRef          properties;
     CFStringRef                     rootKey;
@@ -305,6 +322,43 @@ IOHIDElementType IOHIDElementGetType(IOHIDElementRef element)
     return element->elementStructPtr->type;
 }
 
+//------------------------------------------------------------------------------
+// __IOHIDElementGetDictionaryNumber
+//------------------------------------------------------------------------------
+Boolean __IOHIDElementGetDictionaryNumber(
+                                        CFDictionaryRef         dictionary,
+                                        CFStringRef             key,
+                                        int64_t *               pValue)
+{
+    CFNumberRef number = (CFNumberRef)CFDictionaryGetValue(dictionary, key);
+    
+    if ( !number || (CFGetTypeID(number) != CFNumberGetTypeID()) )
+        return FALSE;
+        
+    return CFNumberGetValue(number, kCFNumberSInt64Type, pValue);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDElementSetDictionaryFlag
+//------------------------------------------------------------------------------
+void __IOHIDElementSetDictionaryFlag(
+                                        CFDictionaryRef         dictionary,
+                                        CFStringRef             key,
+                                        uint32_t                mask,
+                                        Boolean                 setWhenTrue,
+                                        uint32_t *              pFlags)
+{
+    CFBooleanRef boolean = (CFBooleanRef)CFDictionaryGetValue(dictionary, key);
+    
+    if ( !boolean || (CFGetTypeID(boolean) != CFBooleanGetTypeID()) )
+        return;
+        
+    if ( CFBooleanGetValue(boolean) == setWhenTrue )
+        *pFlags |= mask;
+    else
+        *pFlags &= ~mask;
+}
+
 //------------------------------------------------------------------------------
 // IOHIDElementCreateWithDictionary
 //------------------------------------------------------------------------------
@@ -333,10 +387,68 @@ IOHIDElementRef IOHIDElementCreateWithDictionary(
         return NULL;
     }
     
+    CFDataSetLength((CFMutableDataRef)element->data, sizeof(IOHIDElementStruct));
+    
     element->elementStructPtr = (IOHIDElementStruct *)CFDataGetMutableBytePtr(
                                             (CFMutableDataRef)element->data);
     
-    // fill in element->elementStructPtr
+    IOHIDElementStruct *    elementStruct   = element->elementStructPtr;
+    int64_t                 value           = 0;
+    uint32_t                flags           = 0;
+    
+    bzero(elementStruct, sizeof(IOHIDElementStruct));
+    
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementCookieKey), &value) )
+        elementStruct->cookieMin = elementStruct->cookieMax = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementTypeKey), &value) )
+        elementStruct->type = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementCollectionTypeKey), &value) )
+        elementStruct->collectionType = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementUsagePageKey), &value) )
+        elementStruct->usagePage = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementUsageKey), &value) )
+        elementStruct->usageMin = elementStruct->usageMax = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementMinKey), &value) )
+        elementStruct->min = (int32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementMaxKey), &value) )
+        elementStruct->max = (int32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementScaledMinKey), &value) )
+        elementStruct->scaledMin = (int32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementScaledMaxKey), &value) )
+        elementStruct->scaledMax = (int32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementReportIDKey), &value) )
+        elementStruct->reportID = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementReportSizeKey), &value) )
+        elementStruct->reportSize = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementReportCountKey), &value) )
+        elementStruct->reportCount = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementUnitKey), &value) )
+        elementStruct->unit = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementUnitExponentKey), &value) )
+        elementStruct->unitExponent = (uint32_t)value;
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementCollectionCookieKey), &value) )
+        elementStruct->parentCookie = (uint32_t)value;
+        
+    // Total size defaults to the report field size
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementSizeKey), &value) )
+        elementStruct->size = (uint32_t)value;
+    else
+        elementStruct->size = elementStruct->reportSize * elementStruct->reportCount;
+    
+    // A raw flags word is honored first, then the individual boolean keys
+    if ( __IOHIDElementGetDictionaryNumber(dictionary, CFSTR(kIOHIDElementFlagsKey), &value) )
+        flags = (uint32_t)value;
+    else
+        flags = kIOHIDElementFlagsVariableMask;
+    
+    __IOHIDElementSetDictionaryFlag(dictionary, CFSTR(kIOHIDElementIsRelativeKey), kIOHIDElementFlagsRelativeMask, TRUE, &flags);
+    __IOHIDElementSetDictionaryFlag(dictionary, CFSTR(kIOHIDElementIsWrappingKey), kIOHIDElementFlagsWrapMask, TRUE, &flags);
+    __IOHIDElementSetDictionaryFlag(dictionary, CFSTR(kIOHIDElementIsArrayKey), kIOHIDElementFlagsVariableMask, FALSE, &flags);
+    __IOHIDElementSetDictionaryFlag(dictionary, CFSTR(kIOHIDElementIsNonLinearKey), kIOHIDElementFlagsNonLinearMask, TRUE, &flags);
+    __IOHIDElementSetDictionaryFlag(dictionary, CFSTR(kIOHIDElementHasPreferredStateKey), kIOHIDElementFlagsNoPreferredMask, FALSE, &flags);
+    __IOHIDElementSetDictionaryFlag(dictionary, CFSTR(kIOHIDElementHasNullStateKey), kIOHIDElementFlagsNullStateMask, TRUE, &flags);
+    
+    elementStruct->flags = flags;
 
     return element;
 }
@@ -542,6 +654,15 @@ IOHIDDeviceRef IOHIDElementGetDevice(IOHIDElementRef element)
 //------------------------------------------------------------------------------
 IOHIDElementRef IOHIDElementGetParent(IOHIDElementRef element)
 {
+    const IOHIDElementTable * table = __IOHIDElementGetTable(element);
+    
+    if ( table ) {
+        uint32_t parent = table->entries[element->tableIndex].parent;
+        
+        return ( parent != kIOHIDElementTableIndexNone ) ? 
+                                    table->entries[parent].element : NULL;
+    }
+    
     if (!element->parentElement && element->deviceInterface) {
         CFMutableDictionaryRef  matchingDict;
         CFArrayRef              elementArray;
@@ -590,7 +711,21 @@ CFArrayRef IOHIDElementGetChildren(IOHIDElementRef element)
 {
     CFArrayRef childrenArray = NULL;
     
-    if (!element->childElements && element->deviceInterface) {
+    if (!element->childElements && __IOHIDElementGetTable(element)) {
+        const IOHIDElementTable *       table   = element->table;
+        const IOHIDElementTableEntry *  entry   = &table->entries[element->tableIndex];
+        CFMutableArrayRef               array   = NULL;
+        uint32_t                        index;
+        
+        array = CFArrayCreateMutable(kCFAllocatorDefault, entry->childCount, &kCFTypeArrayCallBacks);
+        if ( !array )
+            return NULL;
+        
+        for ( index=entry->firstChild; index!=kIOHIDElementTableIndexNone; index=table->entries[index].nextSibling )
+            CFArrayAppendValue(array, table->entries[index].element);
+        
+        element->childElements = childrenArray = array;
+    } else if (!element->childElements && element->deviceInterface) {
         CFMutableDictionaryRef matchingDict;
         
         matchingDict = CFDictionaryCreateMutable(
@@ -627,6 +762,153 @@ CFArrayRef IOHIDElementGetChildren(IOHIDElementRef element)
     return childrenArray;
 }
 
+//------------------------------------------------------------------------------
+// __IOHIDElementGetTable
+//------------------------------------------------------------------------------
+const IOHIDElementTable * __IOHIDElementGetTable(IOHIDElementRef element)
+{
+    // The device builds its table on first use and links every element to it;
+    // the device clears element->device when it goes away
+    if ( !element->table && element->device )
+        _IOHIDDeviceGetElementTable(element->device);
+        
+    return element->table;
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDElementTableCompareCookies
+//------------------------------------------------------------------------------
+int __IOHIDElementTableCompareCookies(const void * entry1, const void * entry2)
+{
+    uint32_t cookie1 = ((const IOHIDElementTableEntry *)entry1)->cookie;
+    uint32_t cookie2 = ((const IOHIDElementTableEntry *)entry2)->cookie;
+    
+    return (cookie1 > cookie2) - (cookie1 < cookie2);
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDElementTableCreate
+//------------------------------------------------------------------------------
+IOHIDElementTable * _IOHIDElementTableCreate(CFArrayRef elements)
+{
+    IOHIDElementTable *         table;
+    IOHIDElementTableEntry *    entry;
+    IOHIDElementRef             element;
+    uint32_t                    index, count, parent;
+    
+    if ( !elements )
+        return NULL;
+        
+    count = (uint32_t)CFArrayGetCount(elements);
+    table = (IOHIDElementTable *)malloc(sizeof(IOHIDElementTable) + count * sizeof(IOHIDElementTableEntry));
+    if ( !table )
+        return NULL;
+        
+    table->count = count;
+    
+    for ( index=0; index<count; index++ ) {
+        element = (IOHIDElementRef)CFArrayGetValueAtIndex(elements, index);
+        entry   = &table->entries[index];
+        
+        entry->cookie           = (uint32_t)IOHIDElementGetCookie(element);
+        entry->type             = IOHIDElementGetType(element);
+        entry->collectionType   = IOHIDElementGetCollectionType(element);
+        entry->usagePage        = IOHIDElementGetUsagePage(element);
+        entry->usage            = IOHIDElementGetUsage(element);
+        entry->reportID         = IOHIDElementGetReportID(element);
+        entry->reportSize       = IOHIDElementGetReportSize(element);
+        entry->reportCount      = IOHIDElementGetReportCount(element);
+        entry->parent           = kIOHIDElementTableIndexNone;
+        entry->firstChild       = kIOHIDElementTableIndexNone;
+        entry->nextSibling      = kIOHIDElementTableIndexNone;
+        entry->childCount       = 0;
+        entry->element          = (IOHIDElementRef)CFRetain(element);
+    }
+    
+    qsort(table->entries, count, sizeof(IOHIDElementTableEntry), __IOHIDElementTableCompareCookies);
+    
+    for ( index=0; index<count; index++ ) {
+        entry   = &table->entries[index];
+        parent  = _IOHIDElementTableGetIndexForCookie(table, 
+                        (IOHIDElementCookie)entry->element->elementStructPtr->parentCookie);
+        
+        if ( parent != index )
+            entry->parent = parent;
+    }
+    
+    // Link children back to front so that siblings come out in cookie order
+    for ( index=count; index-->0; ) {
+        entry = &table->entries[index];
+        
+        if ( entry->parent == kIOHIDElementTableIndexNone )
+            continue;
+            
+        entry->nextSibling = table->entries[entry->parent].firstChild;
+        table->entries[entry->parent].firstChild = index;
+        table->entries[entry->parent].childCount++;
+    }
+    
+    for ( index=0; index<count; index++ ) {
+        element = table->entries[index].element;
+        
+        element->table      = table;
+        element->tableIndex = index;
+    }
+    
+    return table;
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDElementTableRelease
+//------------------------------------------------------------------------------
+void _IOHIDElementTableRelease(IOHIDElementTable * table)
+{
+    IOHIDElementRef element;
+    uint32_t        index;
+    
+    if ( !table )
+        return;
+    
+    for ( index=0; index<table->count; index++ ) {
+        element = table->entries[index].element;
+        
+        // The next lookup rebuilds through element->device; the device
+        // detaches its elements before it goes away
+        element->table      = NULL;
+        element->tableIndex = 0;
+        
+        CFRelease(element);
+    }
+    
+    free(table);
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDElementTableGetIndexForCookie
+//------------------------------------------------------------------------------
+uint32_t _IOHIDElementTableGetIndexForCookie(
+                                const IOHIDElementTable *   table, 
+                                IOHIDElementCookie          cookie)
+{
+    uint32_t low    = 0;
+    uint32_t high   = table->count;
+    uint32_t middle;
+    
+    while ( low < high ) {
+        middle = low + (high - low) / 2;
+        
+        if ( table->entries[middle].cookie < (uint32_t)cookie )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    
+    if ( (low < table->count) && (table->entries[low].cookie == (uint32_t)cookie) )
+        return low;
+        
+    return kIOHIDElementTableIndexNone;
+}
+
 //------------------------------------------------------------------------------
 // IOHIDElementAttach
 //------------------------------------------------------------------------------
@@ -25,6 +25,8 @@
 #include <IOKit/IOReturn.h>
 #include <stdarg.h>
 #include <asl.h>
+#include <mach/mach_time.h>
+#include <libkern/OSAtomic.h>
 #include "IOHIDLibPrivate.h"
 #include "IOHIDBase.h"
 
@@ -52,6 +54,143 @@ void _IOHIDCallbackApplier(const void *callback,
         ((IOHIDCallback)callback)((void *)callbackContext, context->result, context->sender);
 }
 
+static uint64_t __IOHIDStatisticsAbsoluteToNanoseconds(uint64_t absoluteTime)
+{
+    static mach_timebase_info_data_t timebaseInfo;
+    
+    if ( !timebaseInfo.denom )
+        mach_timebase_info(&timebaseInfo);
+        
+    if ( timebaseInfo.numer == timebaseInfo.denom )
+        return absoluteTime;
+
+    return absoluteTime * timebaseInfo.numer / timebaseInfo.denom;
+}
+
+IOHIDStatistics * _IOHIDStatisticsCreate(void)
+{
+    IOHIDStatistics * statistics = (IOHIDStatistics *)malloc(sizeof(IOHIDStatistics));
+    
+    if ( !statistics )
+        return NULL;
+        
+    _IOHIDStatisticsReset(statistics);
+    
+    return statistics;
+}
+
+void _IOHIDStatisticsReset(IOHIDStatistics * statistics)
+{
+    bzero(statistics, sizeof(IOHIDStatistics));
+    statistics->startTime = mach_absolute_time();
+}
+
+void _IOHIDStatisticsRecordValue(IOHIDStatistics * statistics, IOHIDValueRef value)
+{
+    uint64_t    timeStamp   = IOHIDValueGetTimeStamp(value);
+    uint64_t    now         = mach_absolute_time();
+    uint64_t    latency     = 0;
+    uint32_t    bucket      = 0;
+    
+    OSAtomicIncrement64(&statistics->valueCount);
+    
+    // Values synthesized in user space may carry no timestamp
+    if ( !timeStamp || timeStamp > now )
+        return;
+    
+    latency = __IOHIDStatisticsAbsoluteToNanoseconds(now - timeStamp);
+    if ( latency )
+        bucket = 64 - __builtin_clzll(latency);
+    
+    if ( bucket >= kIOHIDStatisticsLatencyBucketCount )
+        bucket = kIOHIDStatisticsLatencyBucketCount - 1;
+        
+    OSAtomicIncrement64(&statistics->latency[bucket]);
+}
+
+void _IOHIDStatisticsRecordReport(IOHIDStatistics * statistics)
+{
+    OSAtomicIncrement64(&statistics->reportCount);
+}
+
+void _IOHIDStatisticsRecordDrop(IOHIDStatistics * statistics)
+{
+    OSAtomicIncrement64(&statistics->dropCount);
+}
+
+void _IOHIDStatisticsAccumulate(IOHIDStatistics * total, const IOHIDStatistics * statistics)
+{
+    uint32_t index;
+    
+    total->valueCount   += statistics->valueCount;
+    total->reportCount  += statistics->reportCount;
+    total->dropCount    += statistics->dropCount;
+    
+    for ( index=0; index<kIOHIDStatisticsLatencyBucketCount; index++ )
+        total->latency[index] += statistics->latency[index];
+        
+    if ( !total->startTime || (statistics->startTime < total->startTime) )
+        total->startTime = statistics->startTime;
+}
+
+static void __IOHIDStatisticsSetNumber(CFMutableDictionaryRef dict, CFStringRef key, CFNumberType type, const void * valuePtr)
+{
+    CFNumberRef number = CFNumberCreate(kCFAllocatorDefault, type, valuePtr);
+    
+    if ( !number )
+        return;
+        
+    CFDictionarySetValue(dict, key, number);
+    CFRelease(number);
+}
+
+CFDictionaryRef _IOHIDStatisticsCopyDictionary(const IOHIDStatistics * statistics, CFIndex deviceCount)
+{
+    CFMutableDictionaryRef  dict        = NULL;
+    CFMutableArrayRef       histogram   = NULL;
+    IOHIDStatistics         snapshot;
+    double_t                elapsed;
+    double_t                rate        = 0.0;
+    uint32_t                index;
+    
+    // Counters keep moving underneath us; work from a single copy
+    bcopy((const void *)statistics, &snapshot, sizeof(IOHIDStatistics));
+    
+    dict = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    if ( !dict )
+        return NULL;
+    
+    elapsed = __IOHIDStatisticsAbsoluteToNanoseconds(mach_absolute_time() - snapshot.startTime) / 1e9;
+    if ( elapsed > 0.0 )
+        rate = snapshot.valueCount / elapsed;
+        
+    __IOHIDStatisticsSetNumber(dict, CFSTR(kIOHIDStatisticsValueCountKey), kCFNumberSInt64Type, &snapshot.valueCount);
+    __IOHIDStatisticsSetNumber(dict, CFSTR(kIOHIDStatisticsReportCountKey), kCFNumberSInt64Type, &snapshot.reportCount);
+    __IOHIDStatisticsSetNumber(dict, CFSTR(kIOHIDStatisticsDropCountKey), kCFNumberSInt64Type, &snapshot.dropCount);
+    __IOHIDStatisticsSetNumber(dict, CFSTR(kIOHIDStatisticsElapsedTimeKey), kCFNumberDoubleType, &elapsed);
+    __IOHIDStatisticsSetNumber(dict, CFSTR(kIOHIDStatisticsValuesPerSecondKey), kCFNumberDoubleType, &rate);
+    
+    if ( deviceCount )
+        __IOHIDStatisticsSetNumber(dict, CFSTR(kIOHIDStatisticsDeviceCountKey), kCFNumberCFIndexType, &deviceCount);
+    
+    histogram = CFArrayCreateMutable(kCFAllocatorDefault, kIOHIDStatisticsLatencyBucketCount, &kCFTypeArrayCallBacks);
+    if ( histogram ) {
+        for ( index=0; index<kIOHIDStatisticsLatencyBucketCount; index++ ) {
+            CFNumberRef number = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &snapshot.latency[index]);
+            
+            if ( !number )
+                continue;
+                
+            CFArrayAppendValue(histogram, number);
+            CFRelease(number);
+        }
+        CFDictionarySetValue(dict, CFSTR(kIOHIDStatisticsLatencyHistogramKey), histogram);
+        CFRelease(histogram);
+    }
+    
+    return dict;
+}
+
 void _IOHIDLog(int level, const char *format, ...)
 {
     aslmsg msg = NULL;
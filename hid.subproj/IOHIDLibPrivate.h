@@ -27,6 +27,7 @@
 #include <IOKit/hid/IOHIDLib.h>
 #include <IOKit/hid/IOHIDDevicePlugIn.h>
 #include <IOKit/hid/IOHIDLibUserClient.h>
+#include <IOKit/hid/IOHIDUserDevice.h>
 #include <Availability.h>
 
 __BEGIN_DECLS
@@ -41,6 +42,75 @@ typedef struct _IOHIDCalibrationStruct {
     double_t    gran;
 } IOHIDCalibrationInfo;
 
+/*!
+    @defined    kIOHIDDeviceStatisticsKey
+    @abstract   Property key used to opt in to input pipeline statistics.
+    @discussion Setting this key to kCFBooleanTrue on an IOHIDDevice or an
+                IOHIDManager starts collecting value, report and drop counts
+                as well as a latency histogram derived from value timestamps.
+                Setting it to kCFBooleanFalse stops collection.  Getting the
+                key returns a CFDictionary snapshot described by the
+                kIOHIDStatistics*Key constants below.  The snapshot is owned
+                by the object and remains valid until the object is released;
+                every get keeps a new one, so code that polls should use
+                _IOHIDDeviceCopyStatistics or _IOHIDManagerCopyStatistics.
+*/
+#define kIOHIDDeviceStatisticsKey               "IOHIDDeviceStatistics"
+#define kIOHIDStatisticsValueCountKey           "ValueCount"
+#define kIOHIDStatisticsReportCountKey          "ReportCount"
+#define kIOHIDStatisticsDropCountKey            "DropCount"
+#define kIOHIDStatisticsElapsedTimeKey          "ElapsedTime"
+#define kIOHIDStatisticsValuesPerSecondKey      "ValuesPerSecond"
+#define kIOHIDStatisticsLatencyHistogramKey     "LatencyHistogram"
+#define kIOHIDStatisticsDeviceCountKey          "DeviceCount"
+
+/* Bucket i counts latencies in [2^(i-1), 2^i) nanoseconds; the last bucket
+   also absorbs anything larger. */
+#define kIOHIDStatisticsLatencyBucketCount      32
+
+typedef struct _IOHIDStatistics {
+    volatile int64_t    valueCount;
+    volatile int64_t    reportCount;
+    volatile int64_t    dropCount;
+    volatile int64_t    latency[kIOHIDStatisticsLatencyBucketCount];
+    uint64_t            startTime;
+} IOHIDStatistics;
+
+/*!
+    @typedef    IOHIDElementTable
+    @abstract   Flat, index-linked view of every element of a device.
+    @discussion Entries are sorted by cookie.  parent, firstChild and
+                nextSibling are indices into entries, or
+                kIOHIDElementTableIndexNone.  The usage, type and report
+                fields are copied inline so that a walk over a large
+                composite device touches one contiguous block instead of
+                every IOHIDElementRef.  The table holds a reference on each
+                element and is owned by the IOHIDDevice, or the IOHIDReplay,
+                that built it.
+*/
+#define kIOHIDElementTableIndexNone             0xffffffff
+
+typedef struct _IOHIDElementTableEntry {
+    uint32_t            cookie;
+    uint32_t            type;
+    uint32_t            collectionType;
+    uint32_t            usagePage;
+    uint32_t            usage;
+    uint32_t            reportID;
+    uint32_t            reportSize;
+    uint32_t            reportCount;
+    uint32_t            parent;
+    uint32_t            firstChild;
+    uint32_t            nextSibling;
+    uint32_t            childCount;
+    IOHIDElementRef     element;
+} IOHIDElementTableEntry;
+
+typedef struct _IOHIDElementTable {
+    uint32_t                count;
+    IOHIDElementTableEntry  entries[];
+} IOHIDElementTable;
+
 typedef struct _IOHIDCallbackApplierContext {
     IOReturn                result;
     void *                  sender;
@@ -56,6 +126,15 @@ IOHIDElementRef _IOHIDElementCreateWithParentAndData(CFAllocatorRef allocator, I
 CF_EXPORT
 void _IOHIDElementSetDevice(IOHIDElementRef element, IOHIDDeviceRef device);
 
+CF_EXPORT
+IOHIDElementTable * _IOHIDElementTableCreate(CFArrayRef elements);
+
+CF_EXPORT
+void _IOHIDElementTableRelease(IOHIDElementTable * table);
+
+CF_EXPORT
+uint32_t _IOHIDElementTableGetIndexForCookie(const IOHIDElementTable * table, IOHIDElementCookie cookie);
+
 CF_EXPORT
 void _IOHIDElementSetDeviceInterface(IOHIDElementRef element, IOHIDDeviceDeviceInterface ** interface);
 
@@ -87,12 +166,145 @@ CF_EXPORT
 IOCFPlugInInterface ** _IOHIDDeviceGetIOCFPlugInInterface( 
                                 IOHIDDeviceRef                  device);
 
+CF_EXPORT
+const IOHIDElementTable * _IOHIDDeviceGetElementTable(
+                                IOHIDDeviceRef                  device);
+
+CF_EXPORT
+const IOHIDStatistics * _IOHIDDeviceGetStatistics(
+                                IOHIDDeviceRef                  device);
+
+/*!
+    @function   _IOHIDDeviceCopyStatistics
+    @abstract   Returns a new statistics snapshot, as getting
+                kIOHIDDeviceStatisticsKey does, that the caller must release.
+                Returns NULL if statistics are not enabled.
+*/
+CF_EXPORT
+CFDictionaryRef _IOHIDDeviceCopyStatistics(
+                                IOHIDDeviceRef                  device);
+
+/*!
+    @function   _IOHIDManagerCopyStatistics
+    @abstract   Returns a new statistics snapshot totalled over the devices of
+                the manager, as getting kIOHIDDeviceStatisticsKey does, that
+                the caller must release.  Returns NULL if statistics are not
+                enabled.
+*/
+CF_EXPORT
+CFDictionaryRef _IOHIDManagerCopyStatistics(
+                                IOHIDManagerRef                 manager);
+
 CF_EXPORT
 CFArrayRef _IOHIDQueueCopyElements(IOHIDQueueRef queue);
 
 CF_EXPORT 
 void _IOHIDCallbackApplier(const void *callback, const void *callbackContext, void *applierContext);
 
+CF_EXPORT
+IOHIDStatistics * _IOHIDStatisticsCreate(void);
+
+CF_EXPORT
+void _IOHIDStatisticsReset(IOHIDStatistics * statistics);
+
+CF_EXPORT
+void _IOHIDStatisticsRecordValue(IOHIDStatistics * statistics, IOHIDValueRef value);
+
+CF_EXPORT
+void _IOHIDStatisticsRecordReport(IOHIDStatistics * statistics);
+
+CF_EXPORT
+void _IOHIDStatisticsRecordDrop(IOHIDStatistics * statistics);
+
+CF_EXPORT
+void _IOHIDStatisticsAccumulate(IOHIDStatistics * total, const IOHIDStatistics * statistics);
+
+CF_EXPORT
+CFDictionaryRef _IOHIDStatisticsCopyDictionary(const IOHIDStatistics * statistics, CFIndex deviceCount);
+
+/*!
+    @typedef    IOHIDUserDeviceReportHandler
+    @abstract   Consumer for reports submitted to an IOHIDUserDevice created with
+                _IOHIDUserDeviceCreateWithReportHandler.
+*/
+typedef IOReturn (*IOHIDUserDeviceReportHandler)(void * refcon, uint64_t timestamp, const uint8_t * report, CFIndex reportLength);
+
+/*!
+    @function   _IOHIDUserDeviceCreateWithReportHandler
+    @abstract   Creates an IOHIDUserDevice whose reports are consumed in process.
+    @discussion No kernel device is created.  Every report passed to
+                IOHIDUserDeviceHandleReport or IOHIDUserDeviceHandleReports is
+                handed to the handler instead, which makes the submission path
+                measurable without IOHIDResource.  IOHIDUserDeviceHandleReportAsync
+                calls the handler and then its callback synchronously, on the
+                calling thread.
+*/
+CF_EXPORT
+IOHIDUserDeviceRef _IOHIDUserDeviceCreateWithReportHandler(CFAllocatorRef allocator, CFDictionaryRef properties, IOHIDUserDeviceReportHandler handler, void * refcon);
+
+/*!
+    @typedef    IOHIDCaptureRef
+    @abstract   Records the input value stream of HID devices to a file.
+    @discussion Register _IOHIDCaptureValueCallback with the capture as context
+                on an IOHIDManager or IOHIDDevice, or feed values through
+                _IOHIDCaptureRecordValue.  Values are expected on a single
+                thread, typically the run loop the manager is scheduled on.
+                The elements passed to _IOHIDCaptureCreate, for example from
+                IOHIDDeviceCopyMatchingElements, are written to the file when
+                it opens; values of any other element are not recorded.
+*/
+typedef struct __IOHIDCapture * IOHIDCaptureRef;
+
+/*!
+    @typedef    IOHIDReplayRef
+    @abstract   Plays back a file written by IOHIDCaptureRef.
+    @discussion The file is mapped read only.  Elements are rebuilt with
+                IOHIDElementCreateWithDictionary, linked into the recorded
+                collection hierarchy, and each recorded value is delivered
+                to an IOHIDValueCallback with the replay as sender.  Replay
+                is callback only: the elements have no IOHIDDevice, so
+                values are not dispatched to device or manager callbacks,
+                queues or transactions, and IOHIDElementGetDevice returns
+                NULL.
+*/
+typedef struct __IOHIDReplay * IOHIDReplayRef;
+
+enum {
+    kIOHIDReplayOptionsNone                 = 0x0,
+    kIOHIDReplayOptionsMaximumSpeed         = 0x1,  // ignore recorded spacing
+    kIOHIDReplayOptionsPreserveTimeStamps   = 0x2   // deliver recorded timestamps
+};
+
+CF_EXPORT
+CFTypeID _IOHIDCaptureGetTypeID(void);
+
+CF_EXPORT
+IOHIDCaptureRef _IOHIDCaptureCreate(CFAllocatorRef allocator, const char * path, CFArrayRef elements);
+
+CF_EXPORT
+IOReturn _IOHIDCaptureRecordValue(IOHIDCaptureRef capture, IOHIDValueRef value);
+
+CF_EXPORT
+void _IOHIDCaptureValueCallback(void * context, IOReturn result, void * sender, IOHIDValueRef value);
+
+CF_EXPORT
+IOReturn _IOHIDCaptureClose(IOHIDCaptureRef capture);
+
+CF_EXPORT
+CFTypeID _IOHIDReplayGetTypeID(void);
+
+CF_EXPORT
+IOHIDReplayRef _IOHIDReplayCreate(CFAllocatorRef allocator, const char * path);
+
+CF_EXPORT
+CFArrayRef _IOHIDReplayGetElements(IOHIDReplayRef replay);
+
+CF_EXPORT
+CFIndex _IOHIDReplayGetValueCount(IOHIDReplayRef replay);
+
+CF_EXPORT
+IOReturn _IOHIDReplayRun(IOHIDReplayRef replay, IOOptionBits options, IOHIDValueCallback callback, void * context);
+
 CF_EXPORT
 void _IOHIDLog(int level, const char *format, ...) __printflike(2, 3);
 
@@ -21,6 +21,7 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 #include <pthread.h>
+#include <mach/mach_time.h>
 #include <CoreFoundation/CFRuntime.h>
 #include "IOHIDManager.h"
 #include <IOKit/IOKitLib.h>
@@ -51,6 +52,11 @@ static void             __IOHIDManagerInitialEnumCallback(
 static void             __IOHIDManagerMergeDictionaries(
                                     CFDictionaryRef             srcDict, 
                                     CFMutableDictionaryRef      dstDict);
+static CFDictionaryRef  __IOHIDManagerCopyStatistics(
+                                    IOHIDManagerRef             manager);
+static void             __IOHIDManagerStatisticsApplier(
+                                    const void *                value,
+                                    void *                      context);
 
 enum {
     kDeviceApplierOpen                      = 1 << 0,
@@ -103,6 +109,8 @@ typedef struct __IOHIDManager
     
     CFArrayRef                      inputMatchingMultiple;
     Boolean                         isDirty;
+    
+    CFMutableArrayRef               statisticsSnapshots;
 
 } __IOHIDManager, *__IOHIDManagerRef;
 
@@ -221,6 +229,11 @@ void __IOHIDManagerRelease( CFTypeRef object )
         CFRelease(manager->inputMatchingMultiple);
         manager->inputMatchingMultiple = NULL;
     }
+    
+    if ( manager->statisticsSnapshots ) {
+        CFRelease(manager->statisticsSnapshots);
+        manager->statisticsSnapshots = NULL;
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -679,6 +692,25 @@ CFTypeRef IOHIDManagerGetProperty(
     if ( !manager->properties )
         return NULL;
         
+    if ( CFEqual(key, CFSTR(kIOHIDDeviceStatisticsKey)) ) {
+        CFDictionaryRef snapshot = _IOHIDManagerCopyStatistics(manager);
+        
+        if ( !snapshot )
+            return NULL;
+            
+        // Under the Get rule an earlier snapshot may still be in use, so
+        // every one handed out is kept until the manager is released
+        if ( !manager->statisticsSnapshots )
+            manager->statisticsSnapshots = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+            
+        if ( manager->statisticsSnapshots )
+            CFArrayAppendValue(manager->statisticsSnapshots, snapshot);
+            
+        CFRelease(snapshot);
+        
+        return manager->statisticsSnapshots ? snapshot : NULL;
+    }
+    
     return CFDictionaryGetValue(manager->properties, key);
 }
                                 
@@ -703,7 +735,10 @@ Boolean IOHIDManagerSetProperty(
             return FALSE;
     }
     
-    manager->isDirty = TRUE;
+    // The statistics switch is session state and is not persisted
+    if ( !CFEqual(key, CFSTR(kIOHIDDeviceStatisticsKey)) )
+        manager->isDirty = TRUE;
+        
     CFDictionarySetValue(manager->properties, key, value);
     if (manager->devices)
         CFSetApplyFunction(manager->devices, __IOHIDApplyPropertyToDeviceSet, &context);
@@ -711,6 +746,55 @@ Boolean IOHIDManagerSetProperty(
     return TRUE;
 }
                                         
+//------------------------------------------------------------------------------
+// __IOHIDManagerStatisticsApplier
+//------------------------------------------------------------------------------
+void __IOHIDManagerStatisticsApplier(
+                                    const void *                value,
+                                    void *                      context)
+{
+    IOHIDStatistics *       total       = (IOHIDStatistics *)context;
+    const IOHIDStatistics * statistics  = _IOHIDDeviceGetStatistics((IOHIDDeviceRef)value);
+    
+    if ( statistics )
+        _IOHIDStatisticsAccumulate(total, statistics);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDManagerCopyStatistics
+//------------------------------------------------------------------------------
+CFDictionaryRef __IOHIDManagerCopyStatistics(
+                                    IOHIDManagerRef             manager)
+{
+    IOHIDStatistics total;
+    CFIndex         count = 0;
+    
+    bzero(&total, sizeof(IOHIDStatistics));
+    
+    if ( manager->devices ) {
+        count = CFSetGetCount(manager->devices);
+        CFSetApplyFunction(manager->devices, __IOHIDManagerStatisticsApplier, &total);
+    }
+    
+    if ( !total.startTime )
+        total.startTime = mach_absolute_time();
+        
+    return _IOHIDStatisticsCopyDictionary(&total, count);
+}
+
+//------------------------------------------------------------------------------
+// _IOHIDManagerCopyStatistics
+//------------------------------------------------------------------------------
+CFDictionaryRef _IOHIDManagerCopyStatistics(
+                                    IOHIDManagerRef             manager)
+{
+    if ( !manager->properties || 
+         CFDictionaryGetValue(manager->properties, CFSTR(kIOHIDDeviceStatisticsKey)) != kCFBooleanTrue )
+        return NULL;
+        
+    return __IOHIDManagerCopyStatistics(manager);
+}
+
 //------------------------------------------------------------------------------
 // IOHIDManagerSetDeviceMatching
 //------------------------------------------------------------------------------
@@ -397,6 +397,10 @@ IOReturn IOHIDTransactionCommitWithCallback(
     transaction->callback   = callback;
     transaction->context    = context;
     
+    // All pending values go down in one commit.  The family packs output
+    // values into one report per report ID using each element's real bit
+    // layout, which user space doesn't have, and keeps the element values
+    // that IOHIDDeviceGetValue returns in step with what was sent.
     return (*transaction->transactionInterface)->commit(
                                             transaction->transactionInterface,
                                             timeoutMS,
@@ -25,6 +25,7 @@
 #include <AssertMacros.h>
 #include <pthread.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 #include <CoreFoundation/CFRuntime.h>
 #include <CoreFoundation/CFBase.h>
 #include <IOKit/IOCFPlugIn.h>
@@ -34,6 +35,7 @@
 #include <IOKit/hid/IOHIDResourceUserClient.h>
 #include <IOKit/IODataQueueClient.h>
 #include "IOHIDUserDevice.h"
+#include "IOHIDLibPrivate.h"
 #include <IOKit/IOKitLibPrivate.h>
 
 static IOHIDUserDeviceRef   __IOHIDUserDeviceCreate(
@@ -43,6 +45,7 @@ static void                 __IOHIDUserDeviceRelease( CFTypeRef object );
 static void                 __IOHIDUserDeviceRegister(void);
 static void                 __IOHIDUserDeviceQueueCallback(CFMachPortRef port, void *msg, CFIndex size, void *info);
 static void                 __IOHIDUserDeviceHandleReportAsyncCallback(void *refcon, IOReturn result);
+static IOReturn             __IOHIDUserDeviceDeliverReport(IOHIDUserDeviceRef device, uint64_t timestamp, const uint8_t * report, CFIndex reportLength);
 
 typedef struct __IOHIDUserDevice
 {
@@ -71,6 +74,11 @@ typedef struct __IOHIDUserDevice
         IOHIDUserDeviceReportCallback   callback;
         void *                          refcon;
     } setReport, getReport;
+    
+    struct {
+        IOHIDUserDeviceReportHandler    handler;
+        void *                          refcon;
+    } reports;
 
 } __IOHIDUserDevice, *__IOHIDUserDeviceRef;
 
@@ -258,6 +266,33 @@ error:
     return NULL;
 }
 
+//------------------------------------------------------------------------------
+// _IOHIDUserDeviceCreateWithReportHandler
+//------------------------------------------------------------------------------
+IOHIDUserDeviceRef _IOHIDUserDeviceCreateWithReportHandler(
+                                CFAllocatorRef                  allocator, 
+                                CFDictionaryRef                 properties,
+                                IOHIDUserDeviceReportHandler    handler,
+                                void *                          refcon)
+{
+    IOHIDUserDeviceRef  device = NULL;
+    
+    require(properties, error);
+    require(handler, error);
+        
+    device = __IOHIDUserDeviceCreate(allocator, NULL);
+    require(device, error);
+    
+    device->properties      = CFDictionaryCreateCopy(allocator, properties);
+    device->reports.handler = handler;
+    device->reports.refcon  = refcon;
+    
+    return device;
+
+error:
+    return NULL;
+}
+
 //------------------------------------------------------------------------------
 // IOHIDUserDeviceScheduleWithRunLoop
 //------------------------------------------------------------------------------
@@ -439,6 +474,17 @@ IOReturn IOHIDUserDeviceHandleReportAsync(
                                           IOHIDUserDeviceHandleReportAsyncCallback callback,
                                           void *                          refcon)
 {
+    // In process there is nothing to wait for, so the callback is made
+    // synchronously on the caller's thread before this returns
+    if ( device->reports.handler ) {
+        IOReturn result = __IOHIDUserDeviceDeliverReport(device, 0, report, reportLength);
+        
+        if ( callback )
+            (*callback)(refcon, result);
+            
+        return kIOReturnSuccess;
+    }
+    
     IOHIDDeviceHandleReportAsyncContext *pContext = malloc(sizeof(IOHIDDeviceHandleReportAsyncContext));
     
     if (!pContext)
@@ -466,7 +512,63 @@ IOReturn IOHIDUserDeviceHandleReport(
                                 uint8_t *                       report, 
                                 CFIndex                         reportLength)
 {
+    return __IOHIDUserDeviceDeliverReport(device, 0, report, reportLength);
+}
+
+//------------------------------------------------------------------------------
+// __IOHIDUserDeviceDeliverReport
+//------------------------------------------------------------------------------
+IOReturn __IOHIDUserDeviceDeliverReport(
+                                IOHIDUserDeviceRef              device, 
+                                uint64_t                        timestamp,
+                                const uint8_t *                 report, 
+                                CFIndex                         reportLength)
+{
+    if ( device->reports.handler )
+        return (*device->reports.handler)(device->reports.refcon, timestamp ? timestamp : mach_absolute_time(), report, reportLength);
+        
+    // IOHIDResource stamps reports on arrival; it has no timestamp argument
     return IOConnectCallStructMethod(device->connect, kIOHIDResourceDeviceUserClientMethodHandleReport, report, reportLength, NULL, NULL);
 }
 
+//------------------------------------------------------------------------------
+// IOHIDUserDeviceHandleReports
+//------------------------------------------------------------------------------
+IOReturn IOHIDUserDeviceHandleReports(
+                                IOHIDUserDeviceRef              device, 
+                                const IOHIDUserDeviceReport *   reports, 
+                                CFIndex                         reportCount,
+                                CFIndex *                       deliveredCount)
+{
+    IOReturn    ret = kIOReturnSuccess;
+    CFIndex     index;
+    
+    if ( deliveredCount )
+        *deliveredCount = 0;
+        
+    if ( !reports || reportCount <= 0 )
+        return kIOReturnBadArgument;
+        
+    for ( index=0; index<reportCount; index++ )
+        if ( !reports[index].report || reports[index].reportLength <= 0 )
+            return kIOReturnBadArgument;
+    
+    // IOHIDResourceUserClient takes one report per call, so the batch is
+    // delivered in order, one call each, stopping at the first report that
+    // fails
+    for ( index=0; index<reportCount; index++ ) {
+        ret = __IOHIDUserDeviceDeliverReport(device, 
+                                             reports[index].timestamp, 
+                                             reports[index].report, 
+                                             reports[index].reportLength);
+        if ( ret != kIOReturnSuccess )
+            break;
+    }
+    
+    if ( deliveredCount )
+        *deliveredCount = index;
+    
+    return ret;
+}
+
 
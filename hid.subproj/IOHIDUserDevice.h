@@ -37,6 +37,20 @@ typedef struct __IOHIDUserDevice * IOHIDUserDeviceRef;
 typedef IOReturn (*IOHIDUserDeviceReportCallback)(void * refcon, IOHIDReportType type, uint32_t reportID, uint8_t * report, CFIndex reportLength);
 typedef IOReturn (*IOHIDUserDeviceHandleReportAsyncCallback)(void * refcon, IOReturn result);
 
+/*!
+    @typedef    IOHIDUserDeviceReport
+    @abstract   Describes one report submitted with IOHIDUserDeviceHandleReports.
+    @field      timestamp Time at which the report was generated, in mach absolute time.  Pass 0 to
+                have the report stamped at submission.
+    @field      report Buffer containing formated report being issued to HID stack
+    @field      reportLength Report buffer length
+*/
+typedef struct {
+    uint64_t        timestamp;
+    uint8_t *       report;
+    CFIndex         reportLength;
+} IOHIDUserDeviceReport;
+
 /*!
 	@function   IOHIDUserDeviceGetTypeID
 	@abstract   Returns the type identifier of all IOHIDUserDevice instances.
@@ -111,6 +125,10 @@ IOReturn IOHIDUserDeviceHandleReport(IOHIDUserDeviceRef device, uint8_t * report
 /*!
  @function   IOHIDUserDeviceHandleReportAsync
  @abstract   Dispatch a report to the IOHIDUserDevice.
+ @discussion The callback is normally made on the run loop or dispatch queue the device is
+             scheduled with.  For a device created with _IOHIDUserDeviceCreateWithReportHandler
+             the report is handled in process and the callback is made synchronously, on the
+             calling thread, before this function returns.
  @param      device Reference to IOHIDUserDevice 
  @param      report Buffer containing formated report being issued to HID stack
  @param      reportLength Report buffer length
@@ -121,6 +139,26 @@ IOReturn IOHIDUserDeviceHandleReport(IOHIDUserDeviceRef device, uint8_t * report
 CF_EXPORT
 IOReturn IOHIDUserDeviceHandleReportAsync(IOHIDUserDeviceRef device, uint8_t *report, CFIndex reportLength, IOHIDUserDeviceHandleReportAsyncCallback callback, void * refcon);
 
+/*!
+ @function   IOHIDUserDeviceHandleReports
+ @abstract   Dispatch a batch of reports to the IOHIDUserDevice.
+ @discussion The reports are delivered in order, one at a time.  IOHIDResource takes a
+             single report per call, so each report still costs one call into the kernel.
+             Every report is checked before any is delivered, and delivery stops at the
+             first report that fails.  Timestamps reach only a device created in process;
+             the kernel stamps reports on arrival.
+ @param      device Reference to IOHIDUserDevice 
+ @param      reports Array of reports, each with its own timestamp
+ @param      reportCount Number of entries in reports
+ @param      deliveredCount Set to the number of reports handled successfully before delivery
+             stopped, which is reportCount on success (optional)
+ @result     Returns kIOReturnSuccess when every report is handled successfully,
+             kIOReturnBadArgument without delivering any if a report is invalid, otherwise the
+             error for the report at index *deliveredCount.
+ */
+CF_EXPORT
+IOReturn IOHIDUserDeviceHandleReports(IOHIDUserDeviceRef device, const IOHIDUserDeviceReport * reports, CFIndex reportCount, CFIndex * deliveredCount);
+
 __END_DECLS
 
 #endif /* _IOKIT_HID_IOHIDUSERDEVICE_USER_H */
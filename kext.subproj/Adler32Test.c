@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+
+Checks compression_adler32(), the checksum behind mkext_adler32(),
+against its scalar path, a byte-at-a-time reference, and zlib's
+adler32(). Build it with SSSE3 to check the vector path:
+
+cc -O2 -Wall -mssse3 -o adler32test kext.subproj/Adler32Test.c \
+    kext.subproj/compression_util.c -lz
+
+to run:
+
+./adler32test [-s seed]
+
+Every length from 0 to 1024, every length within 32 bytes of a multiple
+of the 5552-byte reduction block up to 8 blocks, and a 16MB buffer are
+checked, each starting at all 16 alignments, over random bytes, all
+zeroes, and all 0xFF (the largest sums, so the likeliest to overflow).
+Exits 0 if every checksum agrees.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "compression_util.h"
+
+#define ADLER32_NMAX        (5552)
+#define SMALL_LENGTH_MAX    (1024)
+#define BLOCK_SLACK         (32)
+#define NUM_BLOCKS          (8)
+#define LARGE_LENGTH        (16 * 1024 * 1024)
+#define NUM_ALIGNMENTS      (16)
+
+enum {
+    kFillRandom = 0,
+    kFillZero,
+    kFillOnes,
+    kNumFills
+};
+
+static const char * fillNames[kNumFills] = {
+    "random",
+    "zero",
+    "0xff",
+};
+
+/*********************************************************************
+* The plain definition, reducing after every byte.
+*********************************************************************/
+static uint32_t adler32Reference(const uint8_t * buffer, size_t length)
+{
+    uint32_t lowHalf  = 1;
+    uint32_t highHalf = 0;
+    size_t   i;
+
+    for (i = 0; i < length; i++) {
+        lowHalf = (lowHalf + buffer[i]) % 65521;
+        highHalf = (highHalf + lowHalf) % 65521;
+    }
+    return (highHalf << 16) | lowHalf;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void fillBuffer(uint8_t * buffer, size_t length, int fill,
+    unsigned * seed)
+{
+    size_t i;
+
+    switch (fill) {
+    case kFillRandom:
+        for (i = 0; i < length; i++) {
+            buffer[i] = (uint8_t)rand_r(seed);
+        }
+        break;
+    case kFillZero:
+        memset(buffer, 0, length);
+        break;
+    case kFillOnes:
+        memset(buffer, 0xff, length);
+        break;
+    }
+}
+
+/*********************************************************************
+* Checks one length at every alignment; returns the number of
+* mismatches.
+*********************************************************************/
+static unsigned checkLength(const uint8_t * buffer, size_t length, int fill)
+{
+    unsigned failures = 0;
+    unsigned alignment;
+
+    for (alignment = 0; alignment < NUM_ALIGNMENTS; alignment++) {
+        const uint8_t * start    = buffer + alignment;
+        uint32_t        expected = adler32Reference(start, length);
+        uint32_t        fast     = compression_adler32(start, length);
+        uint32_t        scalar   = compression_adler32_scalar(start, length);
+        uint32_t        zlib     = (uint32_t)adler32(1L, start, (uInt)length);
+
+        if (fast != expected || scalar != expected || zlib != expected) {
+            fprintf(stderr, "Mismatch for %zu %s bytes at alignment %u: "
+                "reference 0x%08x, fast 0x%08x, scalar 0x%08x, zlib 0x%08x.\n",
+                length, fillNames[fill], alignment,
+                expected, fast, scalar, zlib);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [-s seed]\n", progname);
+}
+
+int main(int argc, char * argv[])
+{
+    int          result   = 1;
+    const char * progname = argv[0];
+    unsigned     seed     = 1;
+    uint8_t    * buffer   = NULL;  // must free
+    unsigned     failures = 0;
+    unsigned     checked  = 0;
+    size_t       length, block;
+    int          fill, delta;
+    int          ch;
+
+    while ((ch = getopt(argc, argv, "s:")) != -1) {
+        switch (ch) {
+            case 's':
+                seed = (unsigned)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(progname);
+                goto finish;
+        }
+    }
+    if (optind != argc) {
+        usage(progname);
+        goto finish;
+    }
+
+    buffer = (uint8_t *)malloc(LARGE_LENGTH + NUM_ALIGNMENTS);
+    if (!buffer) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+
+#if defined(__SSSE3__)
+    printf("Checking the SSSE3 path against the scalar path.\n");
+#else
+    printf("Built without SSSE3; checking the scalar path only.\n");
+#endif /* __SSSE3__ */
+
+    for (fill = 0; fill < kNumFills; fill++) {
+        fillBuffer(buffer, LARGE_LENGTH + NUM_ALIGNMENTS, fill, &seed);
+
+        for (length = 0; length <= SMALL_LENGTH_MAX; length++) {
+            failures += checkLength(buffer, length, fill);
+            checked++;
+        }
+        for (block = 1; block <= NUM_BLOCKS; block++) {
+            for (delta = -BLOCK_SLACK; delta <= BLOCK_SLACK; delta++) {
+                failures += checkLength(buffer,
+                    block * ADLER32_NMAX + delta, fill);
+                checked++;
+            }
+        }
+        failures += checkLength(buffer, LARGE_LENGTH, fill);
+        checked++;
+    }
+
+    printf("%u lengths at %u alignments, %u mismatches.\n",
+        checked, NUM_ALIGNMENTS, failures);
+    result = failures ? 1 : 0;
+
+finish:
+    if (buffer) free(buffer);
+    return result;
+}
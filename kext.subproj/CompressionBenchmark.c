@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+
+Measures the compression ratio and encode/decode throughput of each
+compression_util codec over a corpus of real kexts:
+
+cc -O2 -Wall -o compressionbench kext.subproj/CompressionBenchmark.c \
+    kext.subproj/compression_util.c -lz
+
+to run:
+
+./compressionbench [-r repeat] [path ...]
+
+The paths default to /System/Library/Extensions. Every regular file
+under them (executables, Info.plists, resources) is read into memory
+up front, then compressed and decompressed one file at a time with
+each codec, the way kext caches and mkext entries are. Each round trip
+is checked byte for byte. The best of the repeated runs is reported,
+with throughput in megabytes of uncompressed data per second. Files
+that don't shrink are stored, as compression_encode() callers do, and
+count at full size toward the ratio.
+
+*/
+
+#include <mach/mach_time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "compression_util.h"
+
+typedef struct {
+    uint8_t * data;            // must free
+    size_t    size;
+    uint8_t * compressed;      // must free; NULL if stored
+    size_t    compressedSize;
+} CorpusFile;
+
+typedef struct {
+    CorpusFile * files;        // must free
+    size_t       numFiles;
+    size_t       capacity;
+    uint64_t     totalSize;
+} Corpus;
+
+static const compression_codec codecs[] = {
+    compression_codec_zlib,
+    compression_codec_lz4,
+};
+#define NUM_CODECS  (sizeof(codecs) / sizeof(codecs[0]))
+
+static const char * defaultPaths[] = { "/System/Library/Extensions" };
+#define NUM_DEFAULT_PATHS  (sizeof(defaultPaths) / sizeof(defaultPaths[0]))
+
+static mach_timebase_info_data_t timebase;
+
+/*********************************************************************
+*********************************************************************/
+static double elapsedSeconds(uint64_t start, uint64_t end)
+{
+    return (double)(end - start) * timebase.numer / timebase.denom / 1.0e9;
+}
+
+/*********************************************************************
+*********************************************************************/
+static int readFile(const char * path, off_t size, CorpusFile * file)
+{
+    int       result = -1;
+    int       fd     = -1;
+    uint8_t * data   = NULL;  // must free
+    ssize_t   bytesRead;
+    size_t    total  = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open %s - %s.\n", path, strerror(errno));
+        goto finish;
+    }
+    data = (uint8_t *)malloc((size_t)size);
+    if (!data) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+    while (total < (size_t)size) {
+        bytesRead = read(fd, data + total, (size_t)size - total);
+        if (bytesRead <= 0) {
+            fprintf(stderr, "Can't read %s - %s.\n", path,
+                bytesRead ? strerror(errno) : "file shrank");
+            goto finish;
+        }
+        total += (size_t)bytesRead;
+    }
+
+    file->data = data;
+    file->size = total;
+    data = NULL;
+    result = 0;
+
+finish:
+    if (fd >= 0) close(fd);
+    if (data) free(data);
+    return result;
+}
+
+/*********************************************************************
+* Reads every nonempty regular file under path into the corpus.
+*********************************************************************/
+static int addPath(Corpus * corpus, const char * path)
+{
+    int       result  = -1;
+    FTS     * fts     = NULL;  // must close
+    FTSENT  * entry;
+    char    * paths[] = { (char *)path, NULL };
+
+    fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if (!fts) {
+        fprintf(stderr, "Can't walk %s - %s.\n", path, strerror(errno));
+        goto finish;
+    }
+
+    while ((entry = fts_read(fts))) {
+        if (entry->fts_info != FTS_F || entry->fts_statp->st_size <= 0) {
+            continue;
+        }
+        if (corpus->numFiles == corpus->capacity) {
+            size_t       capacity = corpus->capacity ?
+                                    corpus->capacity * 2 : 256;
+            CorpusFile * files    = (CorpusFile *)realloc(corpus->files,
+                capacity * sizeof(*files));
+
+            if (!files) {
+                fprintf(stderr, "Out of memory.\n");
+                goto finish;
+            }
+            corpus->files = files;
+            corpus->capacity = capacity;
+        }
+        memset(&corpus->files[corpus->numFiles], 0, sizeof(CorpusFile));
+        if (readFile(entry->fts_path, entry->fts_statp->st_size,
+            &corpus->files[corpus->numFiles]) != 0) {
+
+            continue;
+        }
+        corpus->totalSize += corpus->files[corpus->numFiles].size;
+        corpus->numFiles++;
+    }
+
+    result = 0;
+
+finish:
+    if (fts) fts_close(fts);
+    return result;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void freeCompressed(Corpus * corpus)
+{
+    size_t i;
+
+    for (i = 0; i < corpus->numFiles; i++) {
+        if (corpus->files[i].compressed) free(corpus->files[i].compressed);
+        corpus->files[i].compressed = NULL;
+        corpus->files[i].compressedSize = 0;
+    }
+}
+
+/*********************************************************************
+* Compresses every file with codec, recording the time taken and the
+* total output size.
+*********************************************************************/
+static int encodeCorpus(
+    Corpus            * corpus,
+    compression_codec   codec,
+    double            * seconds,
+    uint64_t          * outputSize)
+{
+    uint64_t start;
+    size_t   i;
+
+    freeCompressed(corpus);
+    *outputSize = 0;
+
+    start = mach_absolute_time();
+    for (i = 0; i < corpus->numFiles; i++) {
+        CorpusFile * file = &corpus->files[i];
+
+        if (!compression_encode(codec, file->data, file->size,
+            &file->compressed, &file->compressedSize)) {
+
+            fprintf(stderr, "%s failed to encode file %zu.\n",
+                compression_codec_name(codec), i);
+            return -1;
+        }
+    }
+    *seconds = elapsedSeconds(start, mach_absolute_time());
+
+    for (i = 0; i < corpus->numFiles; i++) {
+        CorpusFile * file = &corpus->files[i];
+
+        *outputSize += file->compressed ? file->compressedSize : file->size;
+    }
+    return 0;
+}
+
+/*********************************************************************
+* Decompresses every file encodeCorpus() compressed into scratch,
+* recording the time taken, then checks each round trip.
+*********************************************************************/
+static int decodeCorpus(
+    Corpus            * corpus,
+    compression_codec   codec,
+    uint8_t           * scratch,
+    double            * seconds)
+{
+    uint64_t start;
+    size_t   i;
+
+   /* Time the decoding alone, then decode again to check it, since
+    * the files share one scratch buffer.
+    */
+    start = mach_absolute_time();
+    for (i = 0; i < corpus->numFiles; i++) {
+        CorpusFile * file = &corpus->files[i];
+
+        if (!file->compressed) {
+            memcpy(scratch, file->data, file->size);
+        } else if (!compression_decode(codec, file->compressed,
+            file->compressedSize, scratch, file->size)) {
+
+            fprintf(stderr, "%s failed to decode file %zu.\n",
+                compression_codec_name(codec), i);
+            return -1;
+        }
+    }
+    *seconds = elapsedSeconds(start, mach_absolute_time());
+
+    for (i = 0; i < corpus->numFiles; i++) {
+        CorpusFile * file = &corpus->files[i];
+
+        if (!file->compressed) {
+            continue;
+        }
+        if (!compression_decode(codec, file->compressed,
+                file->compressedSize, scratch, file->size) ||
+            memcmp(scratch, file->data, file->size) != 0) {
+
+            fprintf(stderr, "%s round trip of file %zu doesn't match.\n",
+                compression_codec_name(codec), i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void usage(const char * progname)
+{
+    fprintf(stderr, "usage: %s [-r repeat] [path ...]\n", progname);
+}
+
+int main(int argc, char * argv[])
+{
+    int           result      = 1;
+    const char  * progname    = argv[0];
+    unsigned      repeat      = 3;
+    Corpus        corpus      = { NULL, 0, 0, 0 };
+    uint8_t     * scratch     = NULL;  // must free
+    size_t        largestFile = 0;
+    uint64_t      outputSize  = 0;
+    double        encodeTime, decodeTime, bestEncode, bestDecode;
+    double        megabytes;
+    unsigned      codec, run;
+    size_t        i;
+    int           ch;
+
+    while ((ch = getopt(argc, argv, "r:")) != -1) {
+        switch (ch) {
+            case 'r':
+                repeat = (unsigned)strtoul(optarg, NULL, 0);
+                if (!repeat) {
+                    repeat = 1;
+                }
+                break;
+            default:
+                usage(progname);
+                goto finish;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    mach_timebase_info(&timebase);
+
+    if (argc) {
+        for (i = 0; i < (size_t)argc; i++) {
+            if (addPath(&corpus, argv[i]) != 0) {
+                goto finish;
+            }
+        }
+    } else {
+        for (i = 0; i < NUM_DEFAULT_PATHS; i++) {
+            if (addPath(&corpus, defaultPaths[i]) != 0) {
+                goto finish;
+            }
+        }
+    }
+    if (!corpus.numFiles) {
+        fprintf(stderr, "No files to compress.\n");
+        goto finish;
+    }
+
+    for (i = 0; i < corpus.numFiles; i++) {
+        if (corpus.files[i].size > largestFile) {
+            largestFile = corpus.files[i].size;
+        }
+    }
+    scratch = (uint8_t *)malloc(largestFile);
+    if (!scratch) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+
+    megabytes = (double)corpus.totalSize / (1024.0 * 1024.0);
+    printf("%zu files, %.1f MB.\n\n", corpus.numFiles, megabytes);
+    printf("%8s %14s %8s %14s %14s\n",
+        "codec", "compressed", "ratio", "encode MB/s", "decode MB/s");
+
+    for (codec = 0; codec < NUM_CODECS; codec++) {
+        bestEncode = bestDecode = -1;
+        for (run = 0; run < repeat; run++) {
+            if (encodeCorpus(&corpus, codecs[codec], &encodeTime,
+                    &outputSize) != 0 ||
+                decodeCorpus(&corpus, codecs[codec], scratch,
+                    &decodeTime) != 0) {
+
+                goto finish;
+            }
+            if (bestEncode < 0 || encodeTime < bestEncode) {
+                bestEncode = encodeTime;
+            }
+            if (bestDecode < 0 || decodeTime < bestDecode) {
+                bestDecode = decodeTime;
+            }
+        }
+        printf("%8s %14llu %8.3f %14.1f %14.1f\n",
+            compression_codec_name(codecs[codec]),
+            (unsigned long long)outputSize,
+            (double)outputSize / (double)corpus.totalSize,
+            megabytes / bestEncode, megabytes / bestDecode);
+    }
+
+    result = 0;
+
+finish:
+    freeCompressed(&corpus);
+    for (i = 0; i < corpus.numFiles; i++) {
+        free(corpus.files[i].data);
+    }
+    if (corpus.files) free(corpus.files);
+    if (scratch) free(scratch);
+    return result;
+}
@@ -0,0 +1,769 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+
+Writes a folder of synthetic kexts for benchmarking the kext library
+(see OSKextBenchmark.c). Only needs libc, so it builds anywhere:
+
+cc -O2 -Wall -o kextcorpusgen kext.subproj/KextCorpusGen.c
+
+to run:
+
+./kextcorpusgen [-s seed] [-d max_dependencies] count folder
+
+Each kext is folder/SyntheticNNNNN.kext, with an Info.plist declaring
+dependencies on the KPIs and on up to max_dependencies earlier synthetic
+kexts (so the graph is acyclic), plus zero to three IOKit personalities.
+Most have an x86_64 MH_KEXT_BUNDLE executable with __TEXT and __DATA
+segments, a kmod_info matching the bundle, a symbol table of exported
+functions, and a UUID; about one in ten is codeless. Each executable
+also imports a few functions from every declared dependency that has
+code, and from the KPIs, through pointers in __data with external
+relocations, so linking has something to resolve. The same seed always
+gives the same corpus.
+
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Mach-O constants, spelled out so this doesn't need <mach-o/loader.h>.
+ */
+#define CORPUS_MH_MAGIC_64          (0xfeedfacfU)
+#define CORPUS_CPU_TYPE_X86_64      (0x01000007)
+#define CORPUS_CPU_SUBTYPE_X86_ALL  (3)
+#define CORPUS_MH_KEXT_BUNDLE       (0xb)
+#define CORPUS_MH_NOUNDEFS          (0x1)
+#define CORPUS_LC_SEGMENT_64        (0x19)
+#define CORPUS_LC_SYMTAB            (0x2)
+#define CORPUS_LC_UUID              (0x1b)
+#define CORPUS_LC_DYSYMTAB          (0xb)
+#define CORPUS_S_ATTR_CODE          (0x80000400)
+#define CORPUS_N_SECT               (0xe)
+#define CORPUS_N_EXT                (0x1)
+#define CORPUS_X86_64_RELOC_UNSIGNED (0)
+#define CORPUS_VM_PROT_RX           (0x5)
+#define CORPUS_VM_PROT_RW           (0x3)
+
+#define CORPUS_PAGE_SIZE            (0x1000)
+#define CORPUS_MACH_HEADER_SIZE     (32)
+#define CORPUS_SEGMENT_SIZE         (72)
+#define CORPUS_SECTION_SIZE         (80)
+#define CORPUS_SYMTAB_SIZE          (24)
+#define CORPUS_UUID_SIZE            (24)
+#define CORPUS_DYSYMTAB_SIZE        (80)
+#define CORPUS_NLIST_SIZE           (16)
+#define CORPUS_RELOC_SIZE           (8)
+#define CORPUS_FUNCTION_SIZE        (16)
+
+/* kmod_info_64_v1_t: next, info_version, id, name[64], version[64],
+ * reference_count, then six 64-bit addresses.
+ */
+#define CORPUS_KMOD_INFO_SIZE       (200)
+#define CORPUS_KMOD_NAME_OFFSET     (16)
+#define CORPUS_KMOD_VERSION_OFFSET  (80)
+
+/* The import pointers follow the kmod_info in __DATA's one page.
+ */
+#define CORPUS_MAX_IMPORTS          ((CORPUS_PAGE_SIZE - CORPUS_KMOD_INFO_SIZE) / 8)
+
+#define CORPUS_ID_FORMAT            "com.example.synthetic.kext%05u"
+#define CORPUS_NAME_FORMAT          "Synthetic%05u"
+#define CORPUS_FUNCTION_FORMAT      "_synthetic%05u_function%u"
+
+/* Every executable exports at least this many functions, so importers
+ * can pick among them without knowing how many a dependency has.
+ */
+#define CORPUS_MIN_FUNCTIONS        (8)
+#define CORPUS_MAX_IMPORTS_PER_KEXT (4)
+#define CORPUS_SYMBOL_NAME_SIZE     (64)
+
+/* Exported by com.apple.kpi.libkern and com.apple.kpi.iokit.
+ */
+#define CORPUS_LIBKERN_IMPORT       "_OSMalloc"
+#define CORPUS_IOKIT_IMPORT         "_IOLog"
+static const char * providerClasses[] = {
+    "IOPCIDevice",
+    "IOResources",
+    "IOUSBDevice",
+    "IOUSBInterface",
+    "IOPlatformDevice",
+    "IOACPIPlatformDevice",
+    "IOBlockStorageDevice",
+    "IOSCSIPeripheralDeviceNub",
+};
+#define NUM_PROVIDER_CLASSES  (sizeof(providerClasses) / sizeof(providerClasses[0]))
+
+/*********************************************************************
+* A small xorshift generator, so corpora don't depend on libc's rand().
+*********************************************************************/
+static uint32_t corpusRandom(uint32_t * state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/*********************************************************************
+*********************************************************************/
+static int makeDirectory(const char * path)
+{
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Can't create %s - %s.\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*********************************************************************
+* Little-endian stores into the executable being built.
+*********************************************************************/
+static void put16(uint8_t * buffer, uint32_t offset, uint16_t value)
+{
+    buffer[offset]     = value & 0xff;
+    buffer[offset + 1] = (value >> 8) & 0xff;
+}
+
+static void put32(uint8_t * buffer, uint32_t offset, uint32_t value)
+{
+    put16(buffer, offset, value & 0xffff);
+    put16(buffer, offset + 2, value >> 16);
+}
+
+static void put64(uint8_t * buffer, uint32_t offset, uint64_t value)
+{
+    put32(buffer, offset, (uint32_t)value);
+    put32(buffer, offset + 4, (uint32_t)(value >> 32));
+}
+
+static void putName(uint8_t * buffer, uint32_t offset, const char * name)
+{
+    strncpy((char *)buffer + offset, name, 16);
+}
+
+/*********************************************************************
+*********************************************************************/
+static uint32_t putSegment(
+    uint8_t    * buffer,
+    uint32_t     offset,
+    const char * segname,
+    const char * sectname,
+    uint64_t     vmaddr,
+    uint64_t     segmentSize,
+    uint64_t     sectionAddr,
+    uint64_t     sectionSize,
+    uint32_t     maxprot,
+    uint32_t     sectionFlags)
+{
+    put32(buffer, offset, CORPUS_LC_SEGMENT_64);
+    put32(buffer, offset + 4, CORPUS_SEGMENT_SIZE + CORPUS_SECTION_SIZE);
+    putName(buffer, offset + 8, segname);
+    put64(buffer, offset + 24, vmaddr);
+    put64(buffer, offset + 32, segmentSize);
+    put64(buffer, offset + 40, vmaddr);         // fileoff
+    put64(buffer, offset + 48, segmentSize);    // filesize
+    put32(buffer, offset + 56, maxprot);
+    put32(buffer, offset + 60, maxprot);        // initprot
+    put32(buffer, offset + 64, 1);              // nsects
+    put32(buffer, offset + 68, 0);              // flags
+    offset += CORPUS_SEGMENT_SIZE;
+
+    putName(buffer, offset, sectname);
+    putName(buffer, offset + 16, segname);
+    put64(buffer, offset + 32, sectionAddr);
+    put64(buffer, offset + 40, sectionSize);
+    put32(buffer, offset + 48, (uint32_t)sectionAddr);  // offset
+    put32(buffer, offset + 52, 4);                      // align, 2^4
+    put32(buffer, offset + 64, sectionFlags);
+    offset += CORPUS_SECTION_SIZE;
+
+    return offset;
+}
+
+/*********************************************************************
+* Lays out an executable with the file offsets equal to the addresses:
+*   __TEXT at 0: the header and load commands, then __text, whose
+*       functions are each a ret padded out with int3s
+*   __DATA at the next page: __data, holding the kmod_info and then
+*       one pointer per import
+*   then the external relocations, the symbol table and its strings,
+*       outside any segment
+* Symbols are the exported _kmod_info and functions, then the imports,
+* undefined. Each import's pointer has an X86_64_RELOC_UNSIGNED
+* external relocation; as ld does for kext bundles, the relocation
+* addresses are relative to __TEXT.
+*********************************************************************/
+static uint8_t * createExecutable(
+    unsigned     index,
+    const char * identifier,
+    const char * version,
+    unsigned     numFunctions,
+    const char * imports,
+    unsigned     numImports,
+    uint32_t   * randomState,
+    size_t     * sizeOut)
+{
+    uint8_t  * result       = NULL;
+    uint8_t  * buffer       = NULL;
+    uint32_t   commandsSize = 2 * (CORPUS_SEGMENT_SIZE + CORPUS_SECTION_SIZE) +
+        CORPUS_SYMTAB_SIZE + CORPUS_DYSYMTAB_SIZE + CORPUS_UUID_SIZE;
+    uint32_t   textOffset   = (CORPUS_MACH_HEADER_SIZE + commandsSize + 15) & ~15U;
+    uint32_t   textSize     = numFunctions * CORPUS_FUNCTION_SIZE;
+    uint32_t   textSegmentSize;
+    uint32_t   dataOffset;
+    uint32_t   importsOffset;
+    uint32_t   relocsOffset;
+    uint32_t   symbolsOffset;
+    uint32_t   stringsOffset;
+    uint32_t   stringsSize;
+    uint32_t   numDefined   = numFunctions + 1;
+    uint32_t   numSymbols   = numDefined + numImports;
+    uint32_t   fileSize;
+    uint32_t   offset;
+    uint32_t   stringIndex;
+    unsigned   i;
+    char       symbolName[CORPUS_SYMBOL_NAME_SIZE];
+
+    textSegmentSize = (textOffset + textSize + CORPUS_PAGE_SIZE - 1) &
+        ~(CORPUS_PAGE_SIZE - 1);
+    dataOffset = textSegmentSize;
+    importsOffset = dataOffset + CORPUS_KMOD_INFO_SIZE;
+    relocsOffset = dataOffset + CORPUS_PAGE_SIZE;
+    symbolsOffset = relocsOffset + numImports * CORPUS_RELOC_SIZE;
+    stringsOffset = symbolsOffset + numSymbols * CORPUS_NLIST_SIZE;
+
+   /* Strings start with a single space, as ld's do, so that index 0
+    * is never a symbol name.
+    */
+    stringsSize = 2 + sizeof("_kmod_info");
+    for (i = 0; i < numFunctions; i++) {
+        stringsSize += snprintf(symbolName, sizeof(symbolName),
+            CORPUS_FUNCTION_FORMAT, index, i) + 1;
+    }
+    for (i = 0; i < numImports; i++) {
+        stringsSize += strlen(imports + i * CORPUS_SYMBOL_NAME_SIZE) + 1;
+    }
+    stringsSize = (stringsSize + 7) & ~7U;
+    fileSize = stringsOffset + stringsSize;
+
+    buffer = (uint8_t *)calloc(1, fileSize);
+    if (!buffer) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+
+    put32(buffer, 0, CORPUS_MH_MAGIC_64);
+    put32(buffer, 4, CORPUS_CPU_TYPE_X86_64);
+    put32(buffer, 8, CORPUS_CPU_SUBTYPE_X86_ALL);
+    put32(buffer, 12, CORPUS_MH_KEXT_BUNDLE);
+    put32(buffer, 16, 5);                       // ncmds
+    put32(buffer, 20, commandsSize);
+    put32(buffer, 24, numImports ? 0 : CORPUS_MH_NOUNDEFS);
+    offset = CORPUS_MACH_HEADER_SIZE;
+
+    offset = putSegment(buffer, offset, "__TEXT", "__text",
+        /* vmaddr */ 0, textSegmentSize, textOffset, textSize,
+        CORPUS_VM_PROT_RX, CORPUS_S_ATTR_CODE);
+    offset = putSegment(buffer, offset, "__DATA", "__data",
+        dataOffset, CORPUS_PAGE_SIZE, dataOffset,
+        CORPUS_KMOD_INFO_SIZE + numImports * 8,
+        CORPUS_VM_PROT_RW, /* flags */ 0);
+
+    put32(buffer, offset, CORPUS_LC_SYMTAB);
+    put32(buffer, offset + 4, CORPUS_SYMTAB_SIZE);
+    put32(buffer, offset + 8, symbolsOffset);
+    put32(buffer, offset + 12, numSymbols);
+    put32(buffer, offset + 16, stringsOffset);
+    put32(buffer, offset + 20, stringsSize);
+    offset += CORPUS_SYMTAB_SIZE;
+
+    put32(buffer, offset, CORPUS_LC_DYSYMTAB);
+    put32(buffer, offset + 4, CORPUS_DYSYMTAB_SIZE);
+    put32(buffer, offset + 16, 0);              // iextdefsym
+    put32(buffer, offset + 20, numDefined);     // nextdefsym
+    put32(buffer, offset + 24, numDefined);     // iundefsym
+    put32(buffer, offset + 28, numImports);     // nundefsym
+    put32(buffer, offset + 64, numImports ? relocsOffset : 0);  // extreloff
+    put32(buffer, offset + 68, numImports);     // nextrel
+    offset += CORPUS_DYSYMTAB_SIZE;
+
+    put32(buffer, offset, CORPUS_LC_UUID);
+    put32(buffer, offset + 4, CORPUS_UUID_SIZE);
+    for (i = 0; i < 16; i += 4) {
+        put32(buffer, offset + 8 + i, corpusRandom(randomState));
+    }
+    offset += CORPUS_UUID_SIZE;
+
+    for (i = 0; i < numFunctions; i++) {
+        memset(buffer + textOffset + i * CORPUS_FUNCTION_SIZE, 0xcc,
+            CORPUS_FUNCTION_SIZE);
+        buffer[textOffset + i * CORPUS_FUNCTION_SIZE] = 0xc3;
+    }
+
+    put32(buffer, dataOffset + 8, 1);           // info_version
+    snprintf((char *)buffer + dataOffset + CORPUS_KMOD_NAME_OFFSET, 64,
+        "%s", identifier);
+    snprintf((char *)buffer + dataOffset + CORPUS_KMOD_VERSION_OFFSET, 64,
+        "%s", version);
+
+   /* r_symbolnum, then r_pcrel 0, r_length 3 (8 bytes), r_extern 1
+    * and r_type from bit 24 up. The pointers themselves stay zero.
+    */
+    for (i = 0; i < numImports; i++) {
+        offset = relocsOffset + i * CORPUS_RELOC_SIZE;
+        put32(buffer, offset, importsOffset + i * 8);
+        put32(buffer, offset + 4, (numDefined + i) | (3U << 25) | (1U << 27) |
+            (CORPUS_X86_64_RELOC_UNSIGNED << 28));
+    }
+
+   /* _kmod_info in section 2, then the functions in section 1, then
+    * the imports, undefined.
+    */
+    stringIndex = 2;
+    buffer[stringsOffset] = ' ';
+    offset = symbolsOffset;
+    strcpy((char *)buffer + stringsOffset + stringIndex, "_kmod_info");
+    put32(buffer, offset, stringIndex);
+    buffer[offset + 4] = CORPUS_N_SECT | CORPUS_N_EXT;
+    buffer[offset + 5] = 2;
+    put64(buffer, offset + 8, dataOffset);
+    stringIndex += sizeof("_kmod_info");
+    offset += CORPUS_NLIST_SIZE;
+
+    for (i = 0; i < numFunctions; i++) {
+        int length = snprintf(symbolName, sizeof(symbolName),
+            CORPUS_FUNCTION_FORMAT, index, i);
+
+        memcpy(buffer + stringsOffset + stringIndex, symbolName, length + 1);
+        put32(buffer, offset, stringIndex);
+        buffer[offset + 4] = CORPUS_N_SECT | CORPUS_N_EXT;
+        buffer[offset + 5] = 1;
+        put64(buffer, offset + 8, textOffset + i * CORPUS_FUNCTION_SIZE);
+        stringIndex += length + 1;
+        offset += CORPUS_NLIST_SIZE;
+    }
+
+    for (i = 0; i < numImports; i++) {
+        const char * name   = imports + i * CORPUS_SYMBOL_NAME_SIZE;
+        size_t       length = strlen(name);
+
+        memcpy(buffer + stringsOffset + stringIndex, name, length + 1);
+        put32(buffer, offset, stringIndex);
+        buffer[offset + 4] = CORPUS_N_EXT;      // N_UNDF, NO_SECT
+        stringIndex += length + 1;
+        offset += CORPUS_NLIST_SIZE;
+    }
+
+    *sizeOut = fileSize;
+    result = buffer;
+    buffer = NULL;
+
+finish:
+    if (buffer) free(buffer);
+    return result;
+}
+
+/*********************************************************************
+* Fills imports with the names of a few functions of each dependency
+* that has code, and of the KPIs; returns how many. imports holds
+* maxImports names of CORPUS_SYMBOL_NAME_SIZE bytes.
+*********************************************************************/
+static unsigned collectImports(
+    char           * imports,
+    unsigned         maxImports,
+    const unsigned * dependencies,
+    unsigned         numDependencies,
+    const uint8_t  * hasCode,
+    int              usesIOKit,
+    uint32_t       * randomState)
+{
+    unsigned numImports = 0;
+    unsigned i, j, first, numPicks;
+
+    if (numImports < maxImports) {
+        strcpy(imports + numImports++ * CORPUS_SYMBOL_NAME_SIZE,
+            CORPUS_LIBKERN_IMPORT);
+    }
+    if (usesIOKit && numImports < maxImports) {
+        strcpy(imports + numImports++ * CORPUS_SYMBOL_NAME_SIZE,
+            CORPUS_IOKIT_IMPORT);
+    }
+
+   /* Consecutive functions from a random start are all distinct, and
+    * all exist since every executable has CORPUS_MIN_FUNCTIONS.
+    */
+    for (i = 0; i < numDependencies; i++) {
+        if (!hasCode[dependencies[i]]) {
+            continue;
+        }
+        first = corpusRandom(randomState) % CORPUS_MIN_FUNCTIONS;
+        numPicks = 1 + corpusRandom(randomState) % CORPUS_MAX_IMPORTS_PER_KEXT;
+        for (j = 0; j < numPicks && numImports < maxImports; j++) {
+            snprintf(imports + numImports++ * CORPUS_SYMBOL_NAME_SIZE,
+                CORPUS_SYMBOL_NAME_SIZE, CORPUS_FUNCTION_FORMAT,
+                dependencies[i], (first + j) % CORPUS_MIN_FUNCTIONS);
+        }
+    }
+    return numImports;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void writePersonality(
+    FILE       * file,
+    unsigned     index,
+    unsigned     personality,
+    const char * identifier,
+    uint32_t   * randomState)
+{
+    const char * providerClass =
+        providerClasses[corpusRandom(randomState) % NUM_PROVIDER_CLASSES];
+
+    fprintf(file,
+        "\t\t<key>Personality%u</key>\n"
+        "\t\t<dict>\n"
+        "\t\t\t<key>CFBundleIdentifier</key>\n"
+        "\t\t\t<string>%s</string>\n"
+        "\t\t\t<key>IOClass</key>\n"
+        "\t\t\t<string>SyntheticDriver%05u</string>\n"
+        "\t\t\t<key>IOProviderClass</key>\n"
+        "\t\t\t<string>%s</string>\n",
+        personality, identifier, index, providerClass);
+
+    if (!strcmp(providerClass, "IOResources")) {
+        fprintf(file,
+            "\t\t\t<key>IOResourceMatch</key>\n"
+            "\t\t\t<string>IOKit</string>\n"
+            "\t\t\t<key>IOMatchCategory</key>\n"
+            "\t\t\t<string>SyntheticDriver%05u</string>\n", index);
+    } else if (!strcmp(providerClass, "IOPCIDevice")) {
+        fprintf(file,
+            "\t\t\t<key>IOPCIMatch</key>\n"
+            "\t\t\t<string>0x%04x106b</string>\n",
+            corpusRandom(randomState) & 0xffff);
+    } else {
+        fprintf(file,
+            "\t\t\t<key>IONameMatch</key>\n"
+            "\t\t\t<string>synthetic,device%u</string>\n",
+            corpusRandom(randomState) % 256);
+    }
+
+    fprintf(file,
+        "\t\t\t<key>IOProbeScore</key>\n"
+        "\t\t\t<integer>%u</integer>\n"
+        "\t\t</dict>\n",
+        corpusRandom(randomState) % 10000);
+}
+
+/*********************************************************************
+*********************************************************************/
+static int writeInfoPlist(
+    const char * path,
+    unsigned     index,
+    const char * identifier,
+    const char * version,
+    int          hasExecutable,
+    unsigned     maxDependencies,
+    unsigned   * dependencies,
+    unsigned   * numDependenciesOut,
+    int        * usesIOKitOut,
+    uint32_t   * randomState)
+{
+    int        result          = -1;
+    FILE     * file            = NULL;
+    unsigned   numDependencies = 0;
+    unsigned   numPicks        = 0;
+    unsigned   numPersonalities;
+    unsigned   pick;
+    unsigned   i, j;
+
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Can't create %s - %s.\n", path, strerror(errno));
+        goto finish;
+    }
+
+    fprintf(file,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
+            "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+        "<plist version=\"1.0\">\n"
+        "<dict>\n"
+        "\t<key>CFBundleDevelopmentRegion</key>\n"
+        "\t<string>English</string>\n");
+    if (hasExecutable) {
+        fprintf(file,
+            "\t<key>CFBundleExecutable</key>\n"
+            "\t<string>" CORPUS_NAME_FORMAT "</string>\n", index);
+    }
+    fprintf(file,
+        "\t<key>CFBundleIdentifier</key>\n"
+        "\t<string>%s</string>\n"
+        "\t<key>CFBundleInfoDictionaryVersion</key>\n"
+        "\t<string>6.0</string>\n"
+        "\t<key>CFBundleName</key>\n"
+        "\t<string>" CORPUS_NAME_FORMAT "</string>\n"
+        "\t<key>CFBundlePackageType</key>\n"
+        "\t<string>KEXT</string>\n"
+        "\t<key>CFBundleShortVersionString</key>\n"
+        "\t<string>%s</string>\n"
+        "\t<key>CFBundleVersion</key>\n"
+        "\t<string>%s</string>\n"
+        "\t<key>OSBundleCompatibleVersion</key>\n"
+        "\t<string>1.0.0</string>\n",
+        identifier, index, version, version);
+
+    numPersonalities = corpusRandom(randomState) % 4;
+    if (numPersonalities) {
+        fprintf(file,
+            "\t<key>IOKitPersonalities</key>\n"
+            "\t<dict>\n");
+        for (i = 0; i < numPersonalities; i++) {
+            writePersonality(file, index, i, identifier, randomState);
+        }
+        fprintf(file, "\t</dict>\n");
+    }
+
+   /* Depend only on earlier kexts, so there are no cycles. Duplicate
+    * picks are dropped.
+    */
+    fprintf(file,
+        "\t<key>OSBundleLibraries</key>\n"
+        "\t<dict>\n"
+        "\t\t<key>com.apple.kpi.libkern</key>\n"
+        "\t\t<string>8.0.0</string>\n");
+    if (numPersonalities) {
+        fprintf(file,
+            "\t\t<key>com.apple.kpi.iokit</key>\n"
+            "\t\t<string>8.0.0</string>\n");
+    }
+    if (index && maxDependencies) {
+        numPicks = corpusRandom(randomState) % (maxDependencies + 1);
+        if (numPicks > index) {
+            numPicks = index;
+        }
+    }
+    for (i = 0; i < numPicks; i++) {
+        pick = corpusRandom(randomState) % index;
+        for (j = 0; j < numDependencies && dependencies[j] != pick; j++) {
+        }
+        if (j < numDependencies) {
+            continue;
+        }
+        dependencies[numDependencies++] = pick;
+        fprintf(file,
+            "\t\t<key>" CORPUS_ID_FORMAT "</key>\n"
+            "\t\t<string>1.0.0</string>\n",
+            pick);
+    }
+    fprintf(file,
+        "\t</dict>\n"
+        "</dict>\n"
+        "</plist>\n");
+
+    if (fclose(file) != 0) {
+        file = NULL;
+        fprintf(stderr, "Can't write %s - %s.\n", path, strerror(errno));
+        goto finish;
+    }
+    file = NULL;
+    *numDependenciesOut = numDependencies;
+    *usesIOKitOut = numPersonalities != 0;
+    result = 0;
+
+finish:
+    if (file) fclose(file);
+    return result;
+}
+
+/*********************************************************************
+* Writes count synthetic kexts into folder, which is created if need
+* be. Returns 0 on success, -1 on failure (with a message on stderr).
+*********************************************************************/
+int KextCorpusGenerate(
+    const char * folder,
+    unsigned     count,
+    unsigned     maxDependencies,
+    uint32_t     seed)
+{
+    int        result       = -1;
+    uint32_t   randomState  = seed ? seed : 1;
+    uint8_t  * executable   = NULL;
+    size_t     executableSize;
+    FILE     * file         = NULL;
+    uint8_t  * hasCode      = NULL;  // must free
+    unsigned * dependencies = NULL;  // must free
+    char     * imports      = NULL;  // must free
+    unsigned   numDependencies;
+    unsigned   numImports;
+    int        usesIOKit;
+    unsigned   i;
+    char       identifier[64];
+    char       version[32];
+    char       path[PATH_MAX];
+
+    hasCode = (uint8_t *)calloc(count ? count : 1, sizeof(*hasCode));
+    dependencies = (unsigned *)calloc(maxDependencies ? maxDependencies : 1,
+        sizeof(*dependencies));
+    imports = (char *)malloc(CORPUS_MAX_IMPORTS * CORPUS_SYMBOL_NAME_SIZE);
+    if (!hasCode || !dependencies || !imports) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+
+    if (makeDirectory(folder) != 0) {
+        goto finish;
+    }
+
+    for (i = 0; i < count; i++) {
+        int hasExecutable = (corpusRandom(&randomState) % 10) != 0;
+
+        hasCode[i] = (uint8_t)hasExecutable;
+
+        snprintf(identifier, sizeof(identifier), CORPUS_ID_FORMAT, i);
+        snprintf(version, sizeof(version), "1.%u.%u", i / 100, i % 100);
+
+        snprintf(path, sizeof(path), "%s/" CORPUS_NAME_FORMAT ".kext", folder, i);
+        if (makeDirectory(path) != 0) {
+            goto finish;
+        }
+        snprintf(path, sizeof(path), "%s/" CORPUS_NAME_FORMAT ".kext/Contents",
+            folder, i);
+        if (makeDirectory(path) != 0) {
+            goto finish;
+        }
+
+        snprintf(path, sizeof(path),
+            "%s/" CORPUS_NAME_FORMAT ".kext/Contents/Info.plist", folder, i);
+        if (writeInfoPlist(path, i, identifier, version, hasExecutable,
+            maxDependencies, dependencies, &numDependencies, &usesIOKit,
+            &randomState) != 0) {
+
+            goto finish;
+        }
+
+        if (!hasExecutable) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/" CORPUS_NAME_FORMAT ".kext/Contents/MacOS",
+            folder, i);
+        if (makeDirectory(path) != 0) {
+            goto finish;
+        }
+
+        numImports = collectImports(imports, CORPUS_MAX_IMPORTS,
+            dependencies, numDependencies, hasCode, usesIOKit, &randomState);
+        executable = createExecutable(i, identifier, version,
+            CORPUS_MIN_FUNCTIONS + corpusRandom(&randomState) % 57,
+            imports, numImports, &randomState, &executableSize);
+        if (!executable) {
+            goto finish;
+        }
+
+        snprintf(path, sizeof(path),
+            "%s/" CORPUS_NAME_FORMAT ".kext/Contents/MacOS/" CORPUS_NAME_FORMAT,
+            folder, i, i);
+        file = fopen(path, "w");
+        if (!file || fwrite(executable, executableSize, 1, file) != 1) {
+            fprintf(stderr, "Can't write %s - %s.\n", path, strerror(errno));
+            goto finish;
+        }
+        if (fclose(file) != 0) {
+            file = NULL;
+            fprintf(stderr, "Can't write %s - %s.\n", path, strerror(errno));
+            goto finish;
+        }
+        file = NULL;
+        free(executable);
+        executable = NULL;
+    }
+
+    result = 0;
+
+finish:
+    if (file) fclose(file);
+    if (executable) free(executable);
+    if (hasCode) free(hasCode);
+    if (dependencies) free(dependencies);
+    if (imports) free(imports);
+    return result;
+}
+
+#ifndef KEXT_CORPUS_NO_MAIN
+/*********************************************************************
+*********************************************************************/
+static void usage(const char * progname)
+{
+    fprintf(stderr,
+        "usage: %s [-s seed] [-d max_dependencies] count folder\n", progname);
+}
+
+int main(int argc, char * argv[])
+{
+    const char * progname        = argv[0];
+    uint32_t     seed            = 1;
+    unsigned     maxDependencies = 4;
+    int          ch;
+
+    while ((ch = getopt(argc, argv, "s:d:")) != -1) {
+        switch (ch) {
+            case 's':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                maxDependencies = (unsigned)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(progname);
+                return 1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 2) {
+        usage(progname);
+        return 1;
+    }
+
+    if (KextCorpusGenerate(argv[1], (unsigned)strtoul(argv[0], NULL, 0),
+        maxDependencies, seed) != 0) {
+
+        return 1;
+    }
+    return 0;
+}
+#endif /* KEXT_CORPUS_NO_MAIN */
@@ -48,9 +48,21 @@ __BEGIN_DECLS
  * The OSKext library provides a comprehensive interface for creating,
  * examining, and loading kernel extensions (kexts).
  *
- * <b>NOTICE:</b> This library is neither thread-safe nor garbage-collection
- * safe. You must use your own locking with threads sharing access to OSKext.
- * You can not use this library in an application with garbage collection.
+ * <b>NOTICE:</b> Lookups of already-created kexts
+ * (such as <code>@link OSKextGetKextWithIdentifier
+ * OSKextGetKextWithIdentifier@/link</code>) may be made from several threads
+ * at once, concurrently with kext creation and release.
+ * Dependency resolution and flushing are serialized internally.
+ * Global settings such as the architecture, log filters, and diagnostics
+ * recording must be set before other threads use the library.
+ * A kext returned under the Get Rule stays valid only as long as
+ * a reference to it is held elsewhere; to use kexts that another thread
+ * may release, look them up with a Copy function such as
+ * <code>@link OSKextCopyKextsWithIdentifier
+ * OSKextCopyKextsWithIdentifier@/link</code>.
+ * Other operations on a single OSKext object require your own locking.
+ * This library is not garbage-collection safe;
+ * you can not use it in an application with garbage collection.
  */
  
 #pragma mark Types and Constants
@@ -733,6 +745,10 @@ OSKextCreateWithIdentifier(
  *
  * @discussion
  * This function is potentially expensive, so use with care.
+ *
+ * The array returned is a snapshot, which kexts created or released
+ * afterward don't change. It remains valid until the next call to this
+ * function on the same thread. It does not retain the kexts in it.
  */
 CF_EXPORT CFArrayRef
 OSKextGetAllKexts(void)
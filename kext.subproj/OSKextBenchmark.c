@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+
+Times each stage of the kext pipeline over synthetic corpora of growing
+size, as written by KextCorpusGen.c:
+
+cc -O2 -Wall -o oskextbench kext.subproj/OSKextBenchmark.c \
+    kext.subproj/KextCorpusGen.c -DKEXT_CORPUS_NO_MAIN \
+    -framework IOKit -framework CoreFoundation
+
+to run:
+
+./oskextbench [-k kernel] [-o folder] [-s seed] [-d max_dependencies]
+    [-r repeat] [count ...]
+
+The counts default to 10 50 100 500 1000 5000. Each corpus is written
+to folder/corpus-<count> (default folder /tmp/oskextbench), then run
+through OSKextCreateKextsFromURLs(), OSKextCopyLoadListForKexts(),
+OSKextCreateMkext(), OSKextCreateKextsFromMkextData() (extracting each
+executable), and, given a kernel, OSKextCreatePrelinkedKernel(). The
+best of the repeated runs of each stage is reported, in total and per
+kext, so the scaling is easy to see. The KPIs the synthetic kexts
+depend on come from /System/Library/Extensions/System.kext, opened
+once up front and not timed. Caches are off throughout.
+
+*/
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/kext/OSKext.h>
+#include <mach/mach_time.h>
+#include <mach-o/arch.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+extern int KextCorpusGenerate(
+    const char * folder,
+    unsigned     count,
+    unsigned     maxDependencies,
+    uint32_t     seed);
+
+enum {
+    kStageCreate = 0,
+    kStageLoadList,
+    kStageMkext,
+    kStageMkextRead,
+    kStagePrelink,
+    kNumStages
+};
+
+static const char * stageNames[kNumStages] = {
+    "create",
+    "load list",
+    "mkext",
+    "mkext read",
+    "prelink",
+};
+
+static const unsigned defaultCounts[] = { 10, 50, 100, 500, 1000, 5000 };
+#define NUM_DEFAULT_COUNTS  (sizeof(defaultCounts) / sizeof(defaultCounts[0]))
+
+static mach_timebase_info_data_t timebase;
+
+#define SAFE_RELEASE_NULL(ptr)  do { if (ptr) { CFRelease(ptr); (ptr) = NULL; } } while (0)
+
+/*********************************************************************
+*********************************************************************/
+static double elapsedMilliseconds(uint64_t start, uint64_t end)
+{
+    return (double)(end - start) * timebase.numer / timebase.denom / 1.0e6;
+}
+
+/*********************************************************************
+*********************************************************************/
+static CFURLRef createURLForPath(const char * path, Boolean isDirectory)
+{
+    return CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+        (const UInt8 *)path, strlen(path), isDirectory);
+}
+
+/*********************************************************************
+* Runs each stage once over the corpus in folder, recording the time
+* of each in milliseconds, or -1 for a stage that wasn't run or failed.
+*********************************************************************/
+static Boolean runPipeline(
+    const char * folder,
+    unsigned     count,
+    CFDataRef    kernelImage,
+    double     * times)
+{
+    Boolean           result      = false;
+    CFURLRef          folderURL   = NULL;  // must release
+    CFArrayRef        folderURLs  = NULL;  // must release
+    CFArrayRef        kexts       = NULL;  // must release
+    CFMutableArrayRef loadList    = NULL;  // must release
+    CFDataRef         mkext       = NULL;  // must release
+    CFArrayRef        mkextKexts  = NULL;  // must release
+    CFDataRef         prelinked   = NULL;  // must release
+    CFDataRef         executable  = NULL;  // must release
+    uint64_t          start;
+    CFIndex           numKexts, i;
+    int               stage;
+
+    for (stage = 0; stage < kNumStages; stage++) {
+        times[stage] = -1;
+    }
+
+    folderURL = createURLForPath(folder, true);
+    if (!folderURL) {
+        goto finish;
+    }
+    folderURLs = CFArrayCreate(kCFAllocatorDefault,
+        (const void **)&folderURL, 1, &kCFTypeArrayCallBacks);
+    if (!folderURLs) {
+        goto finish;
+    }
+
+    start = mach_absolute_time();
+    kexts = OSKextCreateKextsFromURLs(kCFAllocatorDefault, folderURLs);
+    times[kStageCreate] = elapsedMilliseconds(start, mach_absolute_time());
+    if (!kexts) {
+        fprintf(stderr, "Can't create kexts from %s.\n", folder);
+        goto finish;
+    }
+    numKexts = CFArrayGetCount(kexts);
+    if (numKexts != (CFIndex)count) {
+        fprintf(stderr, "Created %ld kexts from %s; expected %u.\n",
+            (long)numKexts, folder, count);
+    }
+
+    start = mach_absolute_time();
+    loadList = OSKextCopyLoadListForKexts(kexts, /* needAll */ false);
+    times[kStageLoadList] = elapsedMilliseconds(start, mach_absolute_time());
+    if (!loadList) {
+        fprintf(stderr, "Can't get load list for %s.\n", folder);
+        times[kStageLoadList] = -1;
+    }
+
+    start = mach_absolute_time();
+    mkext = OSKextCreateMkext(kCFAllocatorDefault, kexts,
+        /* volumeRootURL */ NULL, kOSKextOSBundleRequiredNone,
+        /* compress */ true);
+    times[kStageMkext] = elapsedMilliseconds(start, mach_absolute_time());
+    if (!mkext) {
+        fprintf(stderr, "Can't create mkext from %s.\n", folder);
+        times[kStageMkext] = -1;
+    }
+
+    if (mkext) {
+        start = mach_absolute_time();
+        mkextKexts = OSKextCreateKextsFromMkextData(kCFAllocatorDefault, mkext);
+        if (mkextKexts) {
+            numKexts = CFArrayGetCount(mkextKexts);
+            for (i = 0; i < numKexts; i++) {
+                OSKextRef aKext = (OSKextRef)CFArrayGetValueAtIndex(
+                    mkextKexts, i);
+
+                if (!OSKextDeclaresExecutable(aKext)) {
+                    continue;
+                }
+                executable = OSKextCopyExecutableForArchitecture(aKext,
+                    OSKextGetArchitecture());
+                SAFE_RELEASE_NULL(executable);
+            }
+        }
+        times[kStageMkextRead] = elapsedMilliseconds(start,
+            mach_absolute_time());
+        if (!mkextKexts) {
+            fprintf(stderr, "Can't read mkext created from %s.\n", folder);
+            times[kStageMkextRead] = -1;
+        }
+    }
+
+    if (kernelImage) {
+        start = mach_absolute_time();
+        prelinked = OSKextCreatePrelinkedKernel(kernelImage, kexts,
+            /* volumeRootURL */ NULL, kOSKextKernelcacheSkipAuthenticationFlag,
+            /* symbolsOut */ NULL);
+        times[kStagePrelink] = elapsedMilliseconds(start, mach_absolute_time());
+        if (!prelinked) {
+            fprintf(stderr, "Can't create prelinked kernel from %s.\n", folder);
+            times[kStagePrelink] = -1;
+        }
+    }
+
+    result = true;
+
+finish:
+    SAFE_RELEASE_NULL(prelinked);
+    SAFE_RELEASE_NULL(mkextKexts);
+    SAFE_RELEASE_NULL(mkext);
+    SAFE_RELEASE_NULL(loadList);
+    SAFE_RELEASE_NULL(kexts);
+    SAFE_RELEASE_NULL(folderURLs);
+    SAFE_RELEASE_NULL(folderURL);
+    return result;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void printTable(
+    const char * title,
+    unsigned   * counts,
+    unsigned     numCounts,
+    double     * times,
+    Boolean      perKext)
+{
+    unsigned i;
+    int      stage;
+
+    printf("\n%s\n%8s", title, "kexts");
+    for (stage = 0; stage < kNumStages; stage++) {
+        printf(" %12s", stageNames[stage]);
+    }
+    printf("\n");
+
+    for (i = 0; i < numCounts; i++) {
+        printf("%8u", counts[i]);
+        for (stage = 0; stage < kNumStages; stage++) {
+            double time = times[i * kNumStages + stage];
+
+            if (time < 0) {
+                printf(" %12s", "-");
+            } else if (perKext) {
+                printf(" %12.1f", time * 1000.0 / counts[i]);
+            } else {
+                printf(" %12.1f", time);
+            }
+        }
+        printf("\n");
+    }
+}
+
+/*********************************************************************
+*********************************************************************/
+static void usage(const char * progname)
+{
+    fprintf(stderr,
+        "usage: %s [-k kernel] [-o folder] [-s seed] [-d max_dependencies]\n"
+        "       [-r repeat] [count ...]\n", progname);
+}
+
+int main(int argc, char * argv[])
+{
+    int          result          = 1;
+    const char * progname        = argv[0];
+    const char * kernelPath      = NULL;
+    const char * workFolder      = "/tmp/oskextbench";
+    uint32_t     seed            = 1;
+    unsigned     maxDependencies = 4;
+    unsigned     repeat          = 3;
+    unsigned   * counts          = NULL;  // must free
+    unsigned     numCounts;
+    double     * times           = NULL;  // must free
+    double       runTimes[kNumStages];
+    CFURLRef     systemKextURL   = NULL;  // must release
+    CFArrayRef   systemKextURLs  = NULL;  // must release
+    CFArrayRef   systemKexts     = NULL;  // must release
+    CFURLRef     kernelURL       = NULL;  // must release
+    CFDataRef    kernelImage     = NULL;  // must release
+    char         folder[MAXPATHLEN];
+    unsigned     i, run;
+    int          stage;
+    int          ch;
+
+    while ((ch = getopt(argc, argv, "k:o:s:d:r:")) != -1) {
+        switch (ch) {
+            case 'k':
+                kernelPath = optarg;
+                break;
+            case 'o':
+                workFolder = optarg;
+                break;
+            case 's':
+                seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                maxDependencies = (unsigned)strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                repeat = (unsigned)strtoul(optarg, NULL, 0);
+                if (!repeat) {
+                    repeat = 1;
+                }
+                break;
+            default:
+                usage(progname);
+                goto finish;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    numCounts = argc ? (unsigned)argc : NUM_DEFAULT_COUNTS;
+    counts = (unsigned *)calloc(numCounts, sizeof(*counts));
+    times = (double *)calloc(numCounts * kNumStages, sizeof(*times));
+    if (!counts || !times) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+    for (i = 0; i < numCounts; i++) {
+        counts[i] = argc ? (unsigned)strtoul(argv[i], NULL, 0) :
+            defaultCounts[i];
+    }
+
+    mach_timebase_info(&timebase);
+
+    OSKextSetArchitecture(NXGetArchInfoFromName("x86_64"));
+    OSKextSetUsesCaches(false);
+    OSKextSetLogFilter(kOSKextLogErrorLevel, /* kernel? */ false);
+
+    systemKextURL = createURLForPath("/System/Library/Extensions/System.kext",
+        true);
+    if (systemKextURL) {
+        systemKextURLs = CFArrayCreate(kCFAllocatorDefault,
+            (const void **)&systemKextURL, 1, &kCFTypeArrayCallBacks);
+    }
+    if (systemKextURLs) {
+        systemKexts = OSKextCreateKextsFromURLs(kCFAllocatorDefault,
+            systemKextURLs);
+    }
+    if (!systemKexts) {
+        fprintf(stderr, "Can't open System.kext; "
+            "load lists and prelinking will fail.\n");
+    }
+
+    if (kernelPath) {
+        kernelURL = createURLForPath(kernelPath, false);
+        if (!kernelURL || !CFURLCreateDataAndPropertiesFromResource(
+            kCFAllocatorDefault, kernelURL, &kernelImage,
+            /* properties */ NULL, /* desiredProperties */ NULL,
+            /* errorCode */ NULL)) {
+
+            fprintf(stderr, "Can't read kernel %s.\n", kernelPath);
+            goto finish;
+        }
+    }
+
+    if (mkdir(workFolder, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Can't create %s - %s.\n", workFolder, strerror(errno));
+        goto finish;
+    }
+
+    for (i = 0; i < numCounts; i++) {
+        double * best = &times[i * kNumStages];
+
+        snprintf(folder, sizeof(folder), "%s/corpus-%u", workFolder, counts[i]);
+        fprintf(stderr, "Writing %u kexts to %s.\n", counts[i], folder);
+        if (KextCorpusGenerate(folder, counts[i], maxDependencies, seed) != 0) {
+            goto finish;
+        }
+
+        for (stage = 0; stage < kNumStages; stage++) {
+            best[stage] = -1;
+        }
+        for (run = 0; run < repeat; run++) {
+            if (!runPipeline(folder, counts[i], kernelImage, runTimes)) {
+                goto finish;
+            }
+            for (stage = 0; stage < kNumStages; stage++) {
+                if (runTimes[stage] >= 0 &&
+                    (best[stage] < 0 || runTimes[stage] < best[stage])) {
+
+                    best[stage] = runTimes[stage];
+                }
+            }
+        }
+    }
+
+    printTable("Milliseconds, best of each stage:", counts, numCounts,
+        times, /* perKext */ false);
+    printTable("Microseconds per kext:", counts, numCounts,
+        times, /* perKext */ true);
+
+    result = 0;
+
+finish:
+    SAFE_RELEASE_NULL(kernelImage);
+    SAFE_RELEASE_NULL(kernelURL);
+    SAFE_RELEASE_NULL(systemKexts);
+    SAFE_RELEASE_NULL(systemKextURLs);
+    SAFE_RELEASE_NULL(systemKextURL);
+    if (counts) free(counts);
+    if (times) free(times);
+    return result;
+}
@@ -109,8 +109,22 @@ typedef enum {
     _kOSKextCacheFormatCFXML,
     _kOSKextCacheFormatCFBinary,
     _kOSKextCacheFormatIOXML,
+    _kOSKextCacheFormatMapped,  // CFData written as is, to be mmap'd
 } _OSKextCacheFormat;
 
+/* The codec used to compress caches written by _OSKextWriteCache().
+ * Zlib writes gzip files as always; other codecs write a tagged header
+ * that _OSKextReadCache() uses to pick the decoder, so caches of any
+ * codec can be read whatever is currently set.
+ */
+typedef enum {
+    _kOSKextCacheCodecZlib = 0,
+    _kOSKextCacheCodecLZ4  = 1,
+} _OSKextCacheCodec;
+
+void _OSKextSetCacheCodec(_OSKextCacheCodec codec);
+_OSKextCacheCodec _OSKextGetCacheCodec(void);
+
 Boolean _OSKextReadCache(
     CFTypeRef                 folderURLsOrURL,  // CFArray or CFURLRef
     CFStringRef               cacheName,
@@ -132,6 +146,89 @@ Boolean _OSKextWriteIdentifierCacheForKextsInDirectory(
     CFArrayRef kextArray,
     CFURLRef   directoryURL,
     Boolean    forceFlag);
+
+/* Identifier cache entries always carry a stat signature of their bundle,
+ * so an out-of-date cache only costs a rescan of the bundles that changed.
+ * If this is set, entries also carry a digest of the Info.plist, so that
+ * bundles that were only touched can be reused as well.
+ */
+void _OSKextSetIdentifierCacheHashesContents(Boolean flag);
+
+/* Kexts created from an mkext inflate their executables as they're asked
+ * for, sharing a small cache of recently inflated entries. If this is
+ * set, all of the executables are inflated concurrently when the kexts
+ * are created instead.
+ */
+void _OSKextSetPreextractsMkextEntries(Boolean flag);
+
+/* If set, OSKextCreatePrelinkedKernel() saves each kext's linked image
+ * in this folder, keyed by a digest of the kernel, the kext's executable
+ * and load address, the link options, the linker version, and its
+ * dependencies' keys, and reuses it instead of linking whenever the key
+ * matches. The folder must exist and, like each entry, be owned by
+ * root:wheel and not group or world writable, or the cache isn't used.
+ * Entries are never removed, so it should be cleaned along with other
+ * build products. Pass NULL to stop using a link cache.
+ */
+void _OSKextSetPrelinkLinkCacheURL(CFURLRef folderURL);
+
+/* Authenticates every kext in the array, walking each distinct bundle or
+ * mkext once, concurrently. Walks are shared only within the one call;
+ * OSKextAuthenticate() always walks the bundle afresh. Returns true if
+ * all the kexts are authentic.
+ */
+Boolean _OSKextAuthenticateKexts(CFArrayRef kexts);
+
+/* Returns the personalities of all open kexts, as from
+ * OSKextCopyPersonalitiesOfKexts(), whose matchKey property names
+ * matchValue; for example IOProviderClass IOPCIDevice, or IOPCIMatch
+ * 0x10de8086 (one ID of a list, as written). A plain ID for an IOPCI*Match
+ * key also matches masked IDs such as 0x00008086&0x0000ffff that it agrees
+ * with under the mask; a masked matchValue matches only that exact text.
+ * IOProviderClass, IONameMatch, IOResourceMatch, and the IOPCI*Match keys
+ * are looked up in an index that's kept until kexts are created or
+ * released; other keys are checked against each personality. If kextsOut
+ * is non-NULL it gets the owning kexts, retained, parallel to the result.
+ * The personalities are copies the caller may modify. Returns NULL if
+ * kexts keep being released faster than the index can be rebuilt.
+ */
+CFArrayRef _OSKextCopyPersonalitiesForMatchValue(
+    CFStringRef   matchKey,
+    CFStringRef   matchValue,
+    CFArrayRef  * kextsOut);
+
+/* Like OSKextGenerateDebugSymbols() for many kexts at once, as for every
+ * kext loaded at the time of a panic. Links kexts and their dependencies
+ * with one kxld context, and writes each symbol file into
+ * symbolFolderURL as <bundle id>-<version>.sym rather than returning
+ * them. If loadAddresses is non-NULL it holds a CFNumber load address
+ * for each kext in kexts; otherwise the addresses must already be set,
+ * as by OSKextReadLoadedKextInfo(). Dependencies with no address are
+ * linked at fake addresses, as by OSKextGenerateDebugSymbols(). Only
+ * libraries stay linked once their symbols are written, so memory use
+ * doesn't grow with the number of kexts. Returns true if every symbol
+ * file was written.
+ */
+Boolean _OSKextGenerateDebugSymbolsForKexts(
+    CFArrayRef kexts,
+    CFArrayRef loadAddresses,
+    CFDataRef  kernelImage,
+    CFURLRef   symbolFolderURL);
+
+/* Turns deferred logging on or off. While on, verbose messages that pass
+ * the log filter are recorded unformatted into a lock-free ring for each
+ * logging thread, of ringSize bytes (0 for the default), and formatted
+ * only when drained. Draining outputs them through the log output
+ * function in the order they were logged, with a NULL kext. It happens
+ * on _OSKextDrainLog(), when a thread's ring fills, before any basic,
+ * warning, error, or explicit message goes out, when the log output
+ * function is changed, when deferred logging is turned off, and at exit.
+ * Formats of deferred messages must stay valid until drained, as string
+ * literals do; messages with a format we can't record go out right away.
+ */
+void _OSKextSetDeferredLogging(Boolean flag, size_t ringSize);
+void _OSKextDrainLog(void);
+
 CFArrayRef _OSKextCopyKernelRequests(void);
 OSReturn _OSKextSendResource(
     CFDictionaryRef request,
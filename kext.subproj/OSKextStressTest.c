@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+
+Hammers the kext registries from several threads at once: each thread
+creates kexts by URL, looks kexts up by identifier and over the whole
+registry, and releases what it created, so that kexts are constantly
+dropping their last reference while other threads find them. Uses a
+synthetic corpus as written by KextCorpusGen.c:
+
+cc -O2 -Wall -o oskextstress kext.subproj/OSKextStressTest.c \
+    kext.subproj/KextCorpusGen.c -DKEXT_CORPUS_NO_MAIN \
+    -framework IOKit -framework CoreFoundation
+
+to run:
+
+MallocScribble=1 ./oskextstress [-o folder] [-t threads] [-i iterations]
+    [count]
+
+count defaults to 200 kexts, written to folder (default
+/tmp/oskextstress), threads to 8, and iterations per thread to 2000.
+With MallocScribble set, a kext used after it's freed shows up as a
+crash or a mismatched identifier rather than going unnoticed. Exits 0
+if every lookup returned only live kexts with the identifier asked for.
+
+*/
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/kext/OSKext.h>
+#include <mach-o/arch.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <libkern/OSAtomic.h>
+
+extern int KextCorpusGenerate(
+    const char * folder,
+    unsigned     count,
+    unsigned     maxDependencies,
+    uint32_t     seed);
+
+#define STRESS_ID_FORMAT    "com.example.synthetic.kext%05u"
+#define STRESS_NAME_FORMAT  "Synthetic%05u"
+
+typedef struct {
+    const char       * folder;
+    unsigned           count;
+    unsigned           iterations;
+    unsigned           seed;
+    volatile int32_t * failures;
+} StressThreadArgs;
+
+#define SAFE_RELEASE_NULL(ptr)  do { if (ptr) { CFRelease(ptr); (ptr) = NULL; } } while (0)
+
+/*********************************************************************
+*********************************************************************/
+static void fail(volatile int32_t * failures, const char * message,
+    unsigned index)
+{
+    fprintf(stderr, "%s (kext %u).\n", message, index);
+    OSAtomicIncrement32Barrier(failures);
+}
+
+/*********************************************************************
+* Every kext copied out of the registries must still be intact, with
+* the identifier it was filed under.
+*********************************************************************/
+static void checkKexts(
+    CFArrayRef         kexts,
+    CFStringRef        identifier,
+    unsigned           index,
+    volatile int32_t * failures)
+{
+    CFIndex count, i;
+
+    count = CFArrayGetCount(kexts);
+    for (i = 0; i < count; i++) {
+        OSKextRef   aKext = (OSKextRef)CFArrayGetValueAtIndex(kexts, i);
+        CFStringRef kextIdentifier;
+
+        if (CFGetTypeID(aKext) != OSKextGetTypeID()) {
+            fail(failures, "Registry returned a non-kext", index);
+            continue;
+        }
+        kextIdentifier = OSKextGetIdentifier(aKext);
+        if (!kextIdentifier) {
+            fail(failures, "Registry returned a kext with no identifier", index);
+            continue;
+        }
+        if (identifier && !CFEqual(kextIdentifier, identifier)) {
+            fail(failures, "Registry returned a kext with the wrong identifier",
+                index);
+        }
+    }
+}
+
+/*********************************************************************
+*********************************************************************/
+static void * stressThread(void * arg)
+{
+    StressThreadArgs * args       = (StressThreadArgs *)arg;
+    unsigned           seed       = args->seed;
+    OSKextRef          held[8]    = { NULL, };  // must release each
+    CFURLRef           kextURL    = NULL;       // must release
+    CFStringRef        identifier = NULL;       // must release
+    CFArrayRef         kexts      = NULL;       // must release
+    char               path[MAXPATHLEN];
+    char               identifierCString[64];
+    unsigned           iteration, index, slot;
+
+    for (iteration = 0; iteration < args->iterations; iteration++) {
+        index = rand_r(&seed) % args->count;
+        slot = rand_r(&seed) % (sizeof(held) / sizeof(held[0]));
+
+       /* Drop a kext created earlier, often its last reference, and
+        * create another in its place.
+        */
+        SAFE_RELEASE_NULL(held[slot]);
+        snprintf(path, sizeof(path), "%s/" STRESS_NAME_FORMAT ".kext",
+            args->folder, index);
+        kextURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault,
+            (const UInt8 *)path, strlen(path), /* isDirectory */ true);
+        if (kextURL) {
+            held[slot] = OSKextCreate(kCFAllocatorDefault, kextURL);
+        }
+        SAFE_RELEASE_NULL(kextURL);
+        if (!held[slot]) {
+            fail(args->failures, "Can't create kext", index);
+        }
+
+       /* Look up a kext some other thread may be releasing.
+        */
+        index = rand_r(&seed) % args->count;
+        snprintf(identifierCString, sizeof(identifierCString),
+            STRESS_ID_FORMAT, index);
+        identifier = CFStringCreateWithCString(kCFAllocatorDefault,
+            identifierCString, kCFStringEncodingUTF8);
+        if (identifier) {
+            kexts = OSKextCopyKextsWithIdentifier(identifier);
+            if (kexts) {
+                checkKexts(kexts, identifier, index, args->failures);
+            }
+            SAFE_RELEASE_NULL(kexts);
+        }
+        SAFE_RELEASE_NULL(identifier);
+
+       /* And now and then walk the whole registry.
+        */
+        if (iteration % 16 == 0) {
+            kexts = OSKextFilterRequiredKexts(NULL, kOSKextOSBundleRequiredNone);
+            if (kexts) {
+                checkKexts(kexts, /* identifier */ NULL, index, args->failures);
+            }
+            SAFE_RELEASE_NULL(kexts);
+            (void)OSKextGetAllKexts();
+        }
+    }
+
+    for (slot = 0; slot < sizeof(held) / sizeof(held[0]); slot++) {
+        SAFE_RELEASE_NULL(held[slot]);
+    }
+    return NULL;
+}
+
+/*********************************************************************
+*********************************************************************/
+static void usage(const char * progname)
+{
+    fprintf(stderr,
+        "usage: %s [-o folder] [-t threads] [-i iterations] [count]\n",
+        progname);
+}
+
+int main(int argc, char * argv[])
+{
+    int                result      = 1;
+    const char       * progname    = argv[0];
+    const char       * folder      = "/tmp/oskextstress";
+    unsigned           count       = 200;
+    unsigned           numThreads  = 8;
+    unsigned           iterations  = 2000;
+    pthread_t        * threads     = NULL;  // must free
+    StressThreadArgs * threadArgs  = NULL;  // must free
+    volatile int32_t   failures    = 0;
+    CFArrayRef         leftover    = NULL;  // do not release
+    unsigned           numStarted  = 0;
+    unsigned           i;
+    int                ch;
+
+    while ((ch = getopt(argc, argv, "o:t:i:")) != -1) {
+        switch (ch) {
+            case 'o':
+                folder = optarg;
+                break;
+            case 't':
+                numThreads = (unsigned)strtoul(optarg, NULL, 0);
+                break;
+            case 'i':
+                iterations = (unsigned)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(progname);
+                goto finish;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 1) {
+        usage(progname);
+        goto finish;
+    }
+    if (argc) {
+        count = (unsigned)strtoul(argv[0], NULL, 0);
+    }
+    if (!count || !numThreads) {
+        usage(progname);
+        goto finish;
+    }
+
+    threads = (pthread_t *)calloc(numThreads, sizeof(*threads));
+    threadArgs = (StressThreadArgs *)calloc(numThreads, sizeof(*threadArgs));
+    if (!threads || !threadArgs) {
+        fprintf(stderr, "Out of memory.\n");
+        goto finish;
+    }
+
+    OSKextSetArchitecture(NXGetArchInfoFromName("x86_64"));
+    OSKextSetUsesCaches(false);
+    OSKextSetLogFilter(kOSKextLogErrorLevel, /* kernel? */ false);
+
+    fprintf(stderr, "Writing %u kexts to %s.\n", count, folder);
+    if (KextCorpusGenerate(folder, count, /* maxDependencies */ 4,
+        /* seed */ 1) != 0) {
+
+        goto finish;
+    }
+
+    for (i = 0; i < numThreads; i++) {
+        threadArgs[i].folder = folder;
+        threadArgs[i].count = count;
+        threadArgs[i].iterations = iterations;
+        threadArgs[i].seed = i + 1;
+        threadArgs[i].failures = &failures;
+        if (pthread_create(&threads[i], NULL, &stressThread,
+            &threadArgs[i]) != 0) {
+
+            fprintf(stderr, "Can't create thread - %s.\n", strerror(errno));
+            break;
+        }
+        numStarted++;
+    }
+    for (i = 0; i < numStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (numStarted < numThreads) {
+        goto finish;
+    }
+
+   /* Every thread released everything it created, so nothing should
+    * be left open.
+    */
+    leftover = OSKextGetAllKexts();
+    if (leftover && CFArrayGetCount(leftover)) {
+        fprintf(stderr, "%ld kexts still open after all were released.\n",
+            (long)CFArrayGetCount(leftover));
+        failures++;
+    }
+
+    printf("%u threads, %u iterations each, %d failures.\n",
+        numThreads, iterations, (int)failures);
+    result = failures ? 1 : 0;
+
+finish:
+    if (threads) free(threads);
+    if (threadArgs) free(threadArgs);
+    return result;
+}
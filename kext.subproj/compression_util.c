@@ -0,0 +1,604 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ * 
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <zlib.h>
+
+#include <libkern/OSByteOrder.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif /* __SSSE3__ */
+
+#include "compression_util.h"
+
+static boolean_t zlib_encode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t *dst_size);
+static boolean_t zlib_decode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t dst_size);
+static size_t    lz4_bound(size_t src_size);
+static boolean_t lz4_encode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t *dst_size);
+static boolean_t lz4_decode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t dst_size);
+static uint32_t  adler32_scalar_update(uint32_t adler,
+    const uint8_t *buffer, size_t length);
+
+/*******************************************************************************
+* LZ4 block format parameters. Matches are at least 4 bytes, the last match
+* has to start 12 bytes before the end of the block, and the last 5 bytes
+* are always literals; decoders rely on the last two.
+*******************************************************************************/
+#define LZ4_HASH_BITS      (12)
+#define LZ4_MIN_MATCH      (4)
+#define LZ4_MF_LIMIT       (12)
+#define LZ4_LAST_LITERALS  (5)
+#define LZ4_MAX_OFFSET     (65535)
+#define LZ4_RUN_MASK       (15)
+
+/*******************************************************************************
+*******************************************************************************/
+const char *
+compression_codec_name(compression_codec codec)
+{
+    switch (codec) {
+    case compression_codec_zlib:
+        return "zlib";
+    case compression_codec_lz4:
+        return "lz4";
+    }
+    return "unknown";
+}
+
+/*******************************************************************************
+*******************************************************************************/
+boolean_t
+compression_encode(
+    compression_codec   codec,
+    const uint8_t     * src,
+    size_t              src_size,
+    uint8_t          ** dst_out,
+    size_t            * dst_size_out)
+{
+    boolean_t   result   = FALSE;
+    uint8_t   * dst      = NULL;  // free on error
+    size_t      dst_size = 0;
+
+    *dst_out = NULL;
+    *dst_size_out = 0;
+
+    switch (codec) {
+    case compression_codec_zlib:
+        if (src_size > UINT_MAX) {
+            goto finish;
+        }
+        dst_size = compressBound((uLong)src_size);
+        break;
+    case compression_codec_lz4:
+        dst_size = lz4_bound(src_size);
+        break;
+    default:
+        goto finish;
+    }
+
+    dst = malloc(dst_size);
+    if (!dst) {
+        goto finish;
+    }
+
+    if (codec == compression_codec_zlib) {
+        result = zlib_encode(src, src_size, dst, &dst_size);
+    } else {
+        result = lz4_encode(src, src_size, dst, &dst_size);
+    }
+    if (!result) {
+        goto finish;
+    }
+
+   /* Only hand back the compressed data if it actually shrank.
+    */
+    if (dst_size < src_size) {
+        *dst_out = dst;
+        *dst_size_out = dst_size;
+        dst = NULL;
+    }
+
+finish:
+    if (dst) free(dst);
+    return result;
+}
+
+/*******************************************************************************
+*******************************************************************************/
+boolean_t
+compression_decode(
+    compression_codec   codec,
+    const uint8_t     * src,
+    size_t              src_size,
+    uint8_t           * dst,
+    size_t              dst_size)
+{
+    switch (codec) {
+    case compression_codec_zlib:
+        return zlib_decode(src, src_size, dst, dst_size);
+    case compression_codec_lz4:
+        return lz4_decode(src, src_size, dst, dst_size);
+    }
+    return FALSE;
+}
+
+/*******************************************************************************
+*******************************************************************************/
+void
+compression_header_write(
+    compression_header * header,
+    compression_codec    codec,
+    uint64_t             full_size)
+{
+    header->magic = OSSwapHostToBigInt32(COMPRESSION_HEADER_MAGIC);
+    header->codec = OSSwapHostToBigInt32((uint32_t)codec);
+    header->full_size = OSSwapHostToBigInt64(full_size);
+}
+
+/*******************************************************************************
+*******************************************************************************/
+boolean_t
+compression_header_read(
+    const uint8_t     * buffer,
+    size_t              buffer_size,
+    compression_codec * codec_out,
+    uint64_t          * full_size_out)
+{
+    compression_header header;
+
+    if (buffer_size < sizeof(header)) {
+        return FALSE;
+    }
+
+    memcpy(&header, buffer, sizeof(header));
+    if (OSSwapBigToHostInt32(header.magic) != COMPRESSION_HEADER_MAGIC) {
+        return FALSE;
+    }
+
+    *codec_out = (compression_codec)OSSwapBigToHostInt32(header.codec);
+    *full_size_out = OSSwapBigToHostInt64(header.full_size);
+    return TRUE;
+}
+
+/*******************************************************************************
+* Adler-32 (the same sums as zlib's adler32()).
+*
+* The running sums are only reduced mod ADLER32_BASE once per ADLER32_NMAX
+* bytes, the longest run that can't overflow 32 bits. Within a run, the
+* SSSE3 path takes 16 bytes per step: the low sum gets the bytes' total,
+* and the high sum gets each byte weighted by how many times it would have
+* been added to it (16 down to 1), plus 16 times the low sum as of the start
+* of the step. Whatever is left over goes through the scalar path.
+*******************************************************************************/
+#define ADLER32_BASE   (65521U)
+#define ADLER32_NMAX   (5552)
+
+#if defined(__SSSE3__)
+static inline uint32_t
+adler32_hsum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+#endif /* __SSSE3__ */
+
+uint32_t
+compression_adler32(const uint8_t *buffer, size_t length)
+{
+    uint32_t low_half  = 1;
+    uint32_t high_half = 0;
+
+#if defined(__SSSE3__)
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i ones    = _mm_set1_epi16(1);
+    const __m128i weights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                          8, 7, 6, 5, 4, 3, 2, 1);
+
+    while (length >= 16) {
+        size_t  steps = ADLER32_NMAX / 16;
+        __m128i v_low;
+        __m128i v_high;
+        __m128i v_prefix;
+
+        if (steps > length / 16) {
+            steps = length / 16;
+        }
+        length -= steps * 16;
+
+        v_low    = zero;
+        v_high   = _mm_cvtsi32_si128((int)high_half);
+        v_prefix = _mm_cvtsi32_si128((int)(low_half * steps));
+
+        do {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)buffer);
+
+            v_prefix = _mm_add_epi32(v_prefix, v_low);
+            v_low = _mm_add_epi32(v_low, _mm_sad_epu8(bytes, zero));
+            v_high = _mm_add_epi32(v_high,
+                _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+            buffer += 16;
+        } while (--steps);
+
+        v_high = _mm_add_epi32(v_high, _mm_slli_epi32(v_prefix, 4));
+
+        low_half  = (low_half + adler32_hsum(v_low)) % ADLER32_BASE;
+        high_half = adler32_hsum(v_high) % ADLER32_BASE;
+    }
+#endif /* __SSSE3__ */
+
+    return adler32_scalar_update((high_half << 16) | low_half, buffer, length);
+}
+
+/*******************************************************************************
+*******************************************************************************/
+uint32_t
+compression_adler32_scalar(const uint8_t *buffer, size_t length)
+{
+    return adler32_scalar_update(1, buffer, length);
+}
+
+/*******************************************************************************
+* Continues an Adler-32 over more bytes, a block at a time, unrolled by 8.
+*******************************************************************************/
+static uint32_t
+adler32_scalar_update(uint32_t adler, const uint8_t *buffer, size_t length)
+{
+    uint32_t low_half  = adler & 0xffff;
+    uint32_t high_half = adler >> 16;
+    size_t   block_length;
+
+    while (length) {
+        block_length = length < ADLER32_NMAX ? length : ADLER32_NMAX;
+        length -= block_length;
+
+        while (block_length >= 8) {
+            low_half += buffer[0]; high_half += low_half;
+            low_half += buffer[1]; high_half += low_half;
+            low_half += buffer[2]; high_half += low_half;
+            low_half += buffer[3]; high_half += low_half;
+            low_half += buffer[4]; high_half += low_half;
+            low_half += buffer[5]; high_half += low_half;
+            low_half += buffer[6]; high_half += low_half;
+            low_half += buffer[7]; high_half += low_half;
+            buffer += 8;
+            block_length -= 8;
+        }
+        while (block_length--) {
+            low_half += *buffer++;
+            high_half += low_half;
+        }
+
+        low_half  %= ADLER32_BASE;
+        high_half %= ADLER32_BASE;
+    }
+
+    return (high_half << 16) | low_half;
+}
+
+/*******************************************************************************
+* Deflates into a zlib-wrapped stream, the same format the kernel's mkext
+* reader inflates. dst must hold compressBound(src_size) bytes.
+*******************************************************************************/
+static boolean_t
+zlib_encode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t *dst_size)
+{
+    boolean_t result = FALSE;
+    z_stream  zstream;
+    int       zlib_result;
+
+    if (src_size > UINT_MAX || *dst_size > UINT_MAX) {
+        goto finish;
+    }
+
+    bzero(&zstream, sizeof(zstream));
+    zstream.next_in   = (Bytef *)src;
+    zstream.avail_in  = (uInt)src_size;
+    zstream.next_out  = dst;
+    zstream.avail_out = (uInt)*dst_size;
+
+    zlib_result = deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+        15, 8 /* memLevel */, Z_DEFAULT_STRATEGY);
+    if (zlib_result != Z_OK) {
+        goto finish;
+    }
+
+    zlib_result = deflate(&zstream, Z_FINISH);
+    if (zlib_result == Z_STREAM_END) {
+        *dst_size = zstream.total_out;
+        result = TRUE;
+    }
+
+   /* Don't bother checking return, nothing we can do on fail.
+    */
+    deflateEnd(&zstream);
+
+finish:
+    return result;
+}
+
+/*******************************************************************************
+*******************************************************************************/
+static boolean_t
+zlib_decode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t dst_size)
+{
+    boolean_t result = FALSE;
+    z_stream  zstream;
+    int       zlib_result;
+
+    if (src_size > UINT_MAX || dst_size > UINT_MAX) {
+        goto finish;
+    }
+
+    bzero(&zstream, sizeof(zstream));
+    zstream.next_in   = (Bytef *)src;
+    zstream.avail_in  = (uInt)src_size;
+    zstream.next_out  = dst;
+    zstream.avail_out = (uInt)dst_size;
+
+    zlib_result = inflateInit(&zstream);
+    if (zlib_result != Z_OK) {
+        goto finish;
+    }
+
+    zlib_result = inflate(&zstream, Z_FINISH);
+    if (zlib_result == Z_STREAM_END && zstream.total_out == dst_size) {
+        result = TRUE;
+    }
+
+    inflateEnd(&zstream);
+
+finish:
+    return result;
+}
+
+/*******************************************************************************
+*******************************************************************************/
+static size_t
+lz4_bound(size_t src_size)
+{
+    return src_size + (src_size / 255) + 16;
+}
+
+/*******************************************************************************
+*******************************************************************************/
+static inline uint32_t
+lz4_read32(const uint8_t *p)
+{
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/*******************************************************************************
+*******************************************************************************/
+static inline uint32_t
+lz4_hash(uint32_t value)
+{
+    return (value * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/*******************************************************************************
+*******************************************************************************/
+static uint8_t *
+lz4_write_length(uint8_t *op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/*******************************************************************************
+* Writes one sequence: a run of literals followed by a match, or just the
+* literals if match_length is 0 (the last sequence of a block).
+*******************************************************************************/
+static uint8_t *
+lz4_write_sequence(uint8_t *op, const uint8_t *literals, size_t literal_length,
+    size_t offset, size_t match_length)
+{
+    uint8_t *token = op++;
+
+    if (literal_length >= LZ4_RUN_MASK) {
+        *token = LZ4_RUN_MASK << 4;
+        op = lz4_write_length(op, literal_length - LZ4_RUN_MASK);
+    } else {
+        *token = (uint8_t)(literal_length << 4);
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (match_length) {
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+
+        match_length -= LZ4_MIN_MATCH;
+        if (match_length >= LZ4_RUN_MASK) {
+            *token |= LZ4_RUN_MASK;
+            op = lz4_write_length(op, match_length - LZ4_RUN_MASK);
+        } else {
+            *token |= (uint8_t)match_length;
+        }
+    }
+    return op;
+}
+
+/*******************************************************************************
+* A greedy single-probe LZ4 block compressor. It doesn't compress as well as
+* the reference high-compression mode, but its output is a valid LZ4 block
+* and decoding speed doesn't depend on how hard the encoder worked.
+* dst must hold lz4_bound(src_size) bytes.
+*******************************************************************************/
+static boolean_t
+lz4_encode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t *dst_size)
+{
+    uint32_t        table[1 << LZ4_HASH_BITS];
+    const uint8_t * ip     = src;
+    const uint8_t * anchor = src;
+    const uint8_t * end    = src + src_size;
+    uint8_t       * op     = dst;
+
+    if (src_size > UINT32_MAX) {
+        return FALSE;
+    }
+
+    if (src_size > LZ4_MF_LIMIT) {
+        const uint8_t * match_start_limit = end - LZ4_MF_LIMIT;
+        const uint8_t * match_end_limit   = end - LZ4_LAST_LITERALS;
+
+        bzero(table, sizeof(table));
+
+        while (ip < match_start_limit) {
+            uint32_t        sequence = lz4_read32(ip);
+            uint32_t        hash     = lz4_hash(sequence);
+            const uint8_t * ref      = src + table[hash];
+            size_t          length;
+
+            table[hash] = (uint32_t)(ip - src);
+
+            if (ref >= ip || (size_t)(ip - ref) > LZ4_MAX_OFFSET ||
+                lz4_read32(ref) != sequence) {
+
+                ip++;
+                continue;
+            }
+
+            length = LZ4_MIN_MATCH;
+            while (ip + length < match_end_limit && ref[length] == ip[length]) {
+                length++;
+            }
+
+            op = lz4_write_sequence(op, anchor, ip - anchor, ip - ref, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    op = lz4_write_sequence(op, anchor, end - anchor, 0, 0);
+    *dst_size = op - dst;
+    return TRUE;
+}
+
+/*******************************************************************************
+* Every length and offset is checked against both buffers, so corrupt input
+* fails rather than reading or writing out of bounds.
+*******************************************************************************/
+static boolean_t
+lz4_decode(const uint8_t *src, size_t src_size,
+    uint8_t *dst, size_t dst_size)
+{
+    const uint8_t * ip   = src;
+    const uint8_t * iend = src + src_size;
+    uint8_t       * op   = dst;
+    uint8_t       * oend = dst + dst_size;
+
+    for (;;) {
+        unsigned int token;
+        size_t       length;
+        size_t       offset;
+        uint8_t      byte;
+
+        if (ip >= iend) {
+            return FALSE;
+        }
+        token = *ip++;
+
+        length = token >> 4;
+        if (length == LZ4_RUN_MASK) {
+            do {
+                if (ip >= iend) {
+                    return FALSE;
+                }
+                byte = *ip++;
+                length += byte;
+            } while (byte == 255);
+        }
+        if (length > (size_t)(iend - ip) || length > (size_t)(oend - op)) {
+            return FALSE;
+        }
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+       /* The last sequence has literals only.
+        */
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return FALSE;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return FALSE;
+        }
+
+        length = token & LZ4_RUN_MASK;
+        if (length == LZ4_RUN_MASK) {
+            do {
+                if (ip >= iend) {
+                    return FALSE;
+                }
+                byte = *ip++;
+                length += byte;
+            } while (byte == 255);
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > (size_t)(oend - op)) {
+            return FALSE;
+        }
+
+       /* Matches may overlap the bytes they produce, so copy forward
+        * a byte at a time unless they can't.
+        */
+        if (offset >= length) {
+            memcpy(op, op - offset, length);
+            op += length;
+        } else {
+            const uint8_t * match = op - offset;
+            while (length--) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return (op == oend);
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ * 
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+#ifndef __COMPRESSION_UTIL_H__
+#define __COMPRESSION_UTIL_H__
+
+#include <mach/boolean.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*******************************************************************************
+********************************************************************************
+**                   DO NOT USE THIS API. IT IS VOLATILE.                     **
+********************************************************************************
+*******************************************************************************/
+
+/*! @header compression_util
+Buffer-to-buffer compression with more than one codec, and a small tagged
+header that records which codec was used so that a reader doesn't have to
+be told.
+*/
+
+/*!
+ * @enum compression_codec
+ * @abstract The codecs known to compression_encode and compression_decode.
+ * @discussion
+ *        The numeric values are written into compression_header
+ *        and must not change.
+ * @constant compression_codec_zlib zlib-wrapped deflate. Slow to encode
+ *           but the most compact, and the only format the kernel reads.
+ * @constant compression_codec_lz4 The LZ4 block format. Compresses less
+ *           than zlib but decodes several times faster.
+ */
+typedef enum {
+    compression_codec_zlib = 0,
+    compression_codec_lz4  = 1,
+} compression_codec;
+
+/*!
+ * @define COMPRESSION_HEADER_MAGIC
+ * @abstract The first four bytes of a tagged compressed buffer, 'kcmp'.
+ * @discussion
+ *        Neither gzip (0x1f 0x8b) nor zlib (0x78 ...) data can start with
+ *        this, so a reader can tell a tagged buffer from a bare legacy one.
+ */
+#define COMPRESSION_HEADER_MAGIC  (0x6b636d70)
+
+/*!
+ * @typedef compression_header
+ * @abstract The header in front of a tagged compressed buffer.
+ * @discussion
+ *        All fields are stored big-endian.
+ * @field magic COMPRESSION_HEADER_MAGIC.
+ * @field codec The compression_codec used for the data that follows.
+ * @field full_size The size of the data once decoded.
+ */
+typedef struct compression_header {
+    uint32_t magic;
+    uint32_t codec;
+    uint64_t full_size;
+} compression_header;
+
+/*!
+ * @function compression_codec_name
+ * @abstract Returns a short name for a codec, for logging.
+ * @param codec The codec.
+ * @result A static C string; "unknown" if codec isn't a known codec.
+ */
+const char * compression_codec_name(compression_codec codec);
+
+/*!
+ * @function compression_encode
+ * @abstract Compresses a buffer into a newly allocated buffer.
+ * @discussion
+ *        compression_encode touches no shared state and may be called
+ *        from several threads at once.
+ * @param codec The codec to compress with.
+ * @param src The data to compress.
+ * @param src_size The number of bytes at src.
+ * @param dst_out On success, set to a buffer allocated with malloc holding
+ *        the compressed data, or to NULL if the data doesn't get smaller.
+ *        The caller must free it.
+ * @param dst_size_out On success, set to the number of bytes at *dst_out,
+ *        or 0 if *dst_out is NULL.
+ * @result Returns TRUE on success, FALSE if codec is unknown or on
+ *         allocation or compressor failure.
+ */
+boolean_t compression_encode(
+    compression_codec   codec,
+    const uint8_t     * src,
+    size_t              src_size,
+    uint8_t          ** dst_out,
+    size_t            * dst_size_out);
+
+/*!
+ * @function compression_decode
+ * @abstract Decompresses a buffer whose decoded size is known.
+ * @discussion
+ *        compression_decode never reads past src + src_size or writes past
+ *        dst + dst_size, whatever the input. It touches no shared state.
+ * @param codec The codec the data was compressed with.
+ * @param src The compressed data.
+ * @param src_size The number of bytes at src.
+ * @param dst A buffer to decompress into.
+ * @param dst_size The size of dst, which must be exactly the decoded size.
+ * @result Returns TRUE if the data decoded to exactly dst_size bytes,
+ *         FALSE otherwise.
+ */
+boolean_t compression_decode(
+    compression_codec   codec,
+    const uint8_t     * src,
+    size_t              src_size,
+    uint8_t           * dst,
+    size_t              dst_size);
+
+/*!
+ * @function compression_header_write
+ * @abstract Fills in a compression_header.
+ * @param header The header to fill in.
+ * @param codec The codec the following data is compressed with.
+ * @param full_size The decoded size of the following data.
+ */
+void compression_header_write(
+    compression_header * header,
+    compression_codec    codec,
+    uint64_t             full_size);
+
+/*!
+ * @function compression_header_read
+ * @abstract Checks whether a buffer starts with a compression_header.
+ * @param buffer The buffer to check.
+ * @param buffer_size The number of bytes at buffer.
+ * @param codec_out If the result is TRUE, set to the codec from the header.
+ * @param full_size_out If the result is TRUE, set to the decoded size
+ *        from the header.
+ * @result Returns TRUE if buffer is big enough and starts with
+ *         COMPRESSION_HEADER_MAGIC, FALSE if it doesn't (in which case it
+ *         may be legacy untagged data).
+ */
+boolean_t compression_header_read(
+    const uint8_t     * buffer,
+    size_t              buffer_size,
+    compression_codec * codec_out,
+    uint64_t          * full_size_out);
+
+/*!
+ * @function compression_adler32
+ * @abstract Computes the Adler-32 checksum of a buffer.
+ * @discussion
+ *        Gives the same result as zlib's adler32() started from 1, as used
+ *        by the mkext header. Builds targeting SSSE3 take a vector path
+ *        for most of the buffer.
+ * @param buffer The data to checksum.
+ * @param length The number of bytes at buffer.
+ * @result The checksum.
+ */
+uint32_t compression_adler32(const uint8_t *buffer, size_t length);
+
+/*!
+ * @function compression_adler32_scalar
+ * @abstract Computes the Adler-32 checksum of a buffer without any vector
+ *           code.
+ * @discussion
+ *        This is the path compression_adler32 uses for whatever its vector
+ *        path leaves over, exported so that the two can be checked against
+ *        each other.
+ * @param buffer The data to checksum.
+ * @param length The number of bytes at buffer.
+ * @result The checksum.
+ */
+uint32_t compression_adler32_scalar(const uint8_t *buffer, size_t length);
+
+#endif /* __COMPRESSION_UTIL_H__ */
@@ -25,6 +25,7 @@
  * 
  * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
  */
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 
@@ -48,6 +49,102 @@ static boolean_t macho_swap_64(u_char *file);
 static boolean_t macho_unswap_32(u_char *file);
 static boolean_t macho_unswap_64(u_char *file);
 
+#define CMDSIZE_MULT_32  (4)
+#define CMDSIZE_MULT_64  (8)
+
+/*******************************************************************************
+* Works out the result of a lookup for one matching nlist entry. Returns
+* macho_seek_result_not_found if the search should go on to the next entry
+* with the same name, and macho_seek_result_stop if it should give up.
+*******************************************************************************/
+static macho_seek_result __macho_symbol_value(
+    const macho_index   * index,
+    const void          * nlist_entry,
+          uint8_t       * nlist_type,
+    const void         ** symbol_address)
+{
+    const void        * file_start   = index->file_start;
+    uint8_t             swap         = index->swap;
+    char                sixtyfourbit = index->sixtyfourbit;
+    uint8_t             n_type;
+    uint8_t             n_sect;
+    uint64_t            n_value;
+
+    if (sixtyfourbit) {
+        const struct nlist_64 * seekptr_64 = (const struct nlist_64 *)nlist_entry;
+        n_type  = seekptr_64->n_type;
+        n_sect  = seekptr_64->n_sect;
+        n_value = CondSwapInt64(swap, seekptr_64->n_value);
+    } else {
+        const struct nlist * seekptr = (const struct nlist *)nlist_entry;
+        n_type  = seekptr->n_type;
+        n_sect  = seekptr->n_sect;
+        n_value = (uint64_t)CondSwapInt32(swap, seekptr->n_value);
+    }
+
+    if (nlist_type) {
+        *nlist_type = n_type;
+    }
+    switch (n_type & N_TYPE) {
+        case N_SECT:
+            {
+                void * v_sect_info = macho_index_find_section_numbered(
+                    index, n_sect);
+
+                if (!v_sect_info) {
+                    return macho_seek_result_not_found;
+                }
+
+                if (symbol_address) {
+                    if (sixtyfourbit) {
+                        struct section_64 * sect_info_64 =
+                            (struct section_64 *)v_sect_info;
+
+                        // this isn't right for 64bit? compare below
+                        size_t reloffset = (n_value -
+                            CondSwapInt64(swap, sect_info_64->addr));
+
+                        *symbol_address = file_start;
+                        *symbol_address += CondSwapInt32(swap,
+                            sect_info_64->offset);
+                        *symbol_address += reloffset;
+                    } else {
+                        struct section * sect_info =
+                            (struct section *)v_sect_info;
+
+                        size_t reloffset = (n_value -
+                            CondSwapInt32(swap, sect_info->addr));
+
+                        *symbol_address = file_start;
+                        *symbol_address += CondSwapInt32(swap,
+                            sect_info->offset);
+                        *symbol_address += reloffset;
+                    }
+                }
+                return macho_seek_result_found;
+            }
+            break;
+
+        case N_UNDF:
+            return macho_seek_result_found_no_value;
+            break;
+
+        case N_ABS:
+            return macho_seek_result_found_no_value;
+            break;
+
+      /* We don't chase indirect symbols as they can be external.
+       */
+        case N_INDR:
+            return macho_seek_result_found_no_value;
+            break;
+
+        default:
+            break;
+    }
+    return macho_seek_result_stop;
+}
+
 /*******************************************************************************
 *
 *******************************************************************************/
@@ -59,157 +156,426 @@ macho_seek_result macho_find_symbol(
     const void         ** symbol_address)
 {
     macho_seek_result       result = macho_seek_result_not_found;
-    macho_seek_result       symtab_result = macho_seek_result_not_found;
-    uint8_t                 swap = 0;
-    char                    sixtyfourbit = 0;
+    macho_index           * index = NULL;  // must free
     struct symtab_command * symtab = NULL;
-    struct nlist          * syms_address;
-    struct nlist_64       * syms_address_64;
-    const void            * string_list;
-    char                  * symbol_name;
-    unsigned int            symtab_offset;
-    unsigned int            str_offset;
+    const void            * syms_address;
+    const char            * string_list;
+    uint32_t                string_size;
     unsigned int            num_syms;
-    unsigned int            syms_bytes;
     unsigned int            sym_index;
 
     if (symbol_address) {
          *symbol_address = 0;
     }
 
-    symtab_result = macho_find_symtab(file_start, file_end, &symtab);
-    if (symtab_result != macho_seek_result_found) {
+   /* A match needs both the symtab and its section, so parse the load
+    * commands once; the index has also checked the symbol and string
+    * tables' bounds.
+    */
+    index = macho_index_create(file_start, file_end);
+    if (!index) {
+        result = macho_seek_result_error;
         goto finish;
     }
 
-    if (ISSWAPPEDMACHO(MAGIC32(file_start))) {
-        swap = 1;
+    symtab = index->symtab;
+    if (!symtab) {
+        goto finish;
     }
-    if (ISMACHO64(MAGIC32(file_start))) {
-        sixtyfourbit = 1;
+
+    num_syms = CondSwapInt32(index->swap, symtab->nsyms);
+    syms_address = file_start + CondSwapInt32(index->swap, symtab->symoff);
+    string_list = file_start + CondSwapInt32(index->swap, symtab->stroff);
+    string_size = CondSwapInt32(index->swap, symtab->strsize);
+
+    for (sym_index = 0; sym_index < num_syms; sym_index++) {
+        const void      * seekptr;
+        uint32_t          string_index;
+        uint8_t           n_type;
+
+        if (index->sixtyfourbit) {
+            const struct nlist_64 * seekptr_64 =
+                &((const struct nlist_64 *)syms_address)[sym_index];
+
+            seekptr      = seekptr_64;
+            string_index = CondSwapInt32(index->swap, seekptr_64->n_un.n_strx);
+            n_type       = seekptr_64->n_type;
+        } else {
+            const struct nlist * seekptr_32 =
+                &((const struct nlist *)syms_address)[sym_index];
+
+            seekptr      = seekptr_32;
+            string_index = CondSwapInt32(index->swap, seekptr_32->n_un.n_strx);
+            n_type       = seekptr_32->n_type;
+        }
+
+        if (string_index == 0 || string_index >= string_size ||
+            n_type & N_STAB) {
+
+            continue;
+        }
+
+        if (strcmp(name, string_list + string_index) == 0) {
+            result = __macho_symbol_value(index, seekptr, nlist_type,
+                symbol_address);
+            if (result == macho_seek_result_stop) {
+                result = macho_seek_result_not_found;
+                goto finish;
+            }
+            if (result != macho_seek_result_not_found) {
+                goto finish;
+            }
+        }
     }
 
-    symtab_offset = CondSwapInt32(swap, symtab->symoff);
-    str_offset = CondSwapInt32(swap, symtab->stroff);
-    num_syms   = CondSwapInt32(swap, symtab->nsyms);
+finish:
+    macho_index_free(index);
+    return result;
+}
+
+/*******************************************************************************
+* macho_index_create()
+*
+* One pass over the load commands, with the same checks as
+* macho_scan_load_commands() plus the ones the individual lookups make.
+*******************************************************************************/
+#define MACHO_INDEX_INITIAL_SEGMENTS  (8)
+#define MACHO_INDEX_INITIAL_SECTIONS  (32)
+
+static boolean_t __macho_index_grow(
+    void     ** array,
+    uint32_t    count,
+    uint32_t  * capacity,
+    uint32_t    initial)
+{
+    void     * new_array;
+    uint32_t   new_capacity;
 
-    syms_address = (struct nlist *)(file_start + symtab_offset);
-    syms_address_64 = (struct nlist_64 *)(file_start + symtab_offset);
+    if (count < *capacity) {
+        return TRUE;
+    }
+    new_capacity = *capacity ? *capacity * 2 : initial;
+    new_array = realloc(*array, new_capacity * sizeof(void *));
+    if (!new_array) {
+        return FALSE;
+    }
+    *array = new_array;
+    *capacity = new_capacity;
+    return TRUE;
+}
 
-    string_list = file_start + str_offset;
-    if (sixtyfourbit) {
-        syms_bytes = num_syms * sizeof(struct nlist_64);
+/******************************************************************************/
+
+static boolean_t __macho_index_range_ok(
+    const macho_index * index,
+    uint64_t            offset,
+    uint64_t            size)
+{
+    uint64_t file_size = (char *)index->file_end - (char *)index->file_start;
+
+    return (offset <= file_size && size <= file_size - offset);
+}
+
+/******************************************************************************/
+
+macho_index * macho_index_create(
+    const void * file_start,
+    const void * file_end)
+{
+    macho_index           * result        = NULL;
+    macho_index           * index         = NULL;  // free on error
+    struct mach_header    * mach_header   = (struct mach_header *)file_start;
+    uint32_t                cmdsize_mult  = CMDSIZE_MULT_32;
+    uint32_t                segs_capacity = 0;
+    uint32_t                sects_capacity = 0;
+    uint32_t                num_cmds;
+    uint32_t                sizeofcmds;
+    char                  * cmds_end;
+    struct load_command   * seek_lc;
+    uint32_t                cmd_index;
+    uint8_t                 swap = 0;
+
+    if (!file_start || file_start >= file_end ||
+        (char *)file_end - (char *)file_start < (long)sizeof(struct mach_header)) {
+
+        goto finish;
+    }
+
+    switch (MAGIC32(file_start)) {
+      case MH_MAGIC_64:
+        cmdsize_mult = CMDSIZE_MULT_64;
+        break;
+      case MH_CIGAM_64:
+        cmdsize_mult = CMDSIZE_MULT_64;
+        swap = 1;
+        break;
+      case MH_CIGAM:
+        swap = 1;
+        break;
+      case MH_MAGIC:
+        break;
+      default:
+        goto finish;
+        break;
+    }
+
+    index = (macho_index *)calloc(1, sizeof(*index));
+    if (!index) {
+        goto finish;
+    }
+    index->file_start = file_start;
+    index->file_end = file_end;
+    index->swap = swap;
+    index->sixtyfourbit = (cmdsize_mult == CMDSIZE_MULT_64);
+
+    if (index->sixtyfourbit) {
+        seek_lc = (struct load_command *)
+            (file_start + sizeof(struct mach_header_64));
     } else {
-        syms_bytes = num_syms * sizeof(struct nlist);
+        seek_lc = (struct load_command *)
+            (file_start + sizeof(struct mach_header));
+    }
+    if ((void *)seek_lc > file_end) {
+        goto finish;
     }
 
-    if ((char *)syms_address + syms_bytes > (char *)file_end) {
-        result = macho_seek_result_error;
+    num_cmds   = CondSwapInt32(swap, mach_header->ncmds);
+    sizeofcmds = CondSwapInt32(swap, mach_header->sizeofcmds);
+    cmds_end = (char *)seek_lc + sizeofcmds;
+
+    if (cmds_end > (char *)file_end) {
         goto finish;
     }
 
-    for (sym_index = 0; sym_index < num_syms; sym_index++) {
-        struct nlist    * seekptr;
-        struct nlist_64 * seekptr_64;
-        uint32_t          string_index;
-        uint8_t           n_type;
-        uint8_t           n_sect;
-        uint64_t          n_value;
+    for (cmd_index = 0; cmd_index < num_cmds; cmd_index++) {
+        uint32_t cmd;
+        uint32_t cmd_size;
 
-        if (sixtyfourbit) {
-            seekptr_64   = &syms_address_64[sym_index];
-            string_index = CondSwapInt32(swap, seekptr_64->n_un.n_strx);
-            n_type       = seekptr_64->n_type;
-            n_sect       = seekptr_64->n_sect;
-            n_value      = CondSwapInt64(swap, seekptr_64->n_value);
-        } else {
-            seekptr      = &syms_address[sym_index];
-            string_index = CondSwapInt32(swap, seekptr->n_un.n_strx);
-            n_type       = seekptr->n_type;
-            n_sect       = seekptr->n_sect;
-            n_value      = (uint64_t)CondSwapInt32(swap, seekptr->n_value);
+        if ((char *)seek_lc + sizeof(struct load_command) > cmds_end) {
+            goto finish;
         }
 
-        if (string_index == 0 || n_type & N_STAB) {
-            continue;
-        }
-        symbol_name = (char *)(string_list + string_index);
+        cmd = CondSwapInt32(swap, seek_lc->cmd);
+        cmd_size = CondSwapInt32(swap, seek_lc->cmdsize);
 
-        if (strcmp(name, symbol_name) == 0) {
+        if (cmd_size < sizeof(struct load_command) ||
+            (cmd_size % cmdsize_mult != 0) ||
+            ((char *)seek_lc + cmd_size > cmds_end)) {
 
-            if (nlist_type) {
-                *nlist_type = n_type;
-            }
-            switch (n_type & N_TYPE) {
-                case N_SECT:
-                    {
-                        void * v_sect_info = macho_find_section_numbered(
-                            file_start, file_end, n_sect);
-    
-    
-                        if (!v_sect_info) {
-                            break;  // out of the switch
-                        }
-                        
-                        if (symbol_address) {
-                            if (sixtyfourbit) {
-                                struct section_64 * sect_info_64 =
-                                    (struct section_64 *)v_sect_info;
-        
-                                // this isn't right for 64bit? compare below
-                                size_t reloffset = (n_value -
-                                    CondSwapInt64(swap, sect_info_64->addr));
-        
-                                *symbol_address = file_start;
-                                *symbol_address += CondSwapInt32(swap,
-                                    sect_info_64->offset);
-                                *symbol_address += reloffset;
-                            } else {
-                                struct section * sect_info =
-                                    (struct section *)v_sect_info;
-        
-                                size_t reloffset = (n_value -
-                                    CondSwapInt32(swap, sect_info->addr));
-        
-                                *symbol_address = file_start;
-                                *symbol_address += CondSwapInt32(swap,
-                                    sect_info->offset);
-                                *symbol_address += reloffset;
-                            }
-                        }
-                        result = macho_seek_result_found;
-                        goto finish;
-                    }
-                    break;
-    
-                case N_UNDF:
-                    result = macho_seek_result_found_no_value;
-                    goto finish;
-                    break;
-  
-                case N_ABS:
-                    result = macho_seek_result_found_no_value;
+            goto finish;
+        }
+
+        if (cmd == LC_SEGMENT_64 || cmd == LC_SEGMENT) {
+            uint32_t   seg_size;
+            uint32_t   sect_size;
+            uint32_t   num_sects;
+            uint64_t   fileoff;
+            uint64_t   filesize;
+            uint32_t   sect_index;
+            char     * segname;
+
+            if (cmd == LC_SEGMENT_64) {
+                struct segment_command_64 * seg_cmd =
+                    (struct segment_command_64 *)seek_lc;
+
+                seg_size = sizeof(*seg_cmd);
+                sect_size = sizeof(struct section_64);
+                if (cmd_size < seg_size) {
                     goto finish;
-                    break;
-  
-              /* We don't chase indirect symbols as they can be external.
-               */
-                case N_INDR:
-                    result = macho_seek_result_found_no_value;
+                }
+                num_sects = CondSwapInt32(swap, seg_cmd->nsects);
+                fileoff = CondSwapInt64(swap, seg_cmd->fileoff);
+                filesize = CondSwapInt64(swap, seg_cmd->filesize);
+                segname = seg_cmd->segname;
+            } else {
+                struct segment_command * seg_cmd =
+                    (struct segment_command *)seek_lc;
+
+                seg_size = sizeof(*seg_cmd);
+                sect_size = sizeof(struct section);
+                if (cmd_size < seg_size) {
                     goto finish;
-                    break;
-    
-                default:
+                }
+                num_sects = CondSwapInt32(swap, seg_cmd->nsects);
+                fileoff = CondSwapInt32(swap, seg_cmd->fileoff);
+                filesize = CondSwapInt32(swap, seg_cmd->filesize);
+                segname = seg_cmd->segname;
+            }
+
+            if ((uint64_t)cmd_size != seg_size + (uint64_t)num_sects * sect_size) {
+                goto finish;
+            }
+
+            if (!__macho_index_grow((void **)&index->segments,
+                index->num_segments, &segs_capacity,
+                MACHO_INDEX_INITIAL_SEGMENTS)) {
+
+                goto finish;
+            }
+            index->segments[index->num_segments++] = seek_lc;
+
+            for (sect_index = 0; sect_index < num_sects; sect_index++) {
+                if (!__macho_index_grow((void **)&index->sections,
+                    index->num_sections, &sects_capacity,
+                    MACHO_INDEX_INITIAL_SECTIONS)) {
+
                     goto finish;
-                    break;
+                }
+                index->sections[index->num_sections++] =
+                    (char *)seek_lc + seg_size + (sect_index * sect_size);
+            }
+
+            if (!index->linkedit &&
+                !strncmp(segname, SEG_LINKEDIT, sizeof(((struct segment_command *)0)->segname))) {
+
+                index->linkedit = seek_lc;
+                index->linkedit_fileoff = fileoff;
+                index->linkedit_filesize = filesize;
+            }
+        } else if (cmd == LC_SYMTAB) {
+            struct symtab_command * symtab = (struct symtab_command *)seek_lc;
+            uint64_t                nlist_size;
+
+            if (cmd_size != sizeof(*symtab)) {
+                goto finish;
+            }
+            nlist_size = index->sixtyfourbit ?
+                sizeof(struct nlist_64) : sizeof(struct nlist);
+            if (!__macho_index_range_ok(index,
+                    CondSwapInt32(swap, symtab->symoff),
+                    nlist_size * CondSwapInt32(swap, symtab->nsyms)) ||
+                !__macho_index_range_ok(index,
+                    CondSwapInt32(swap, symtab->stroff),
+                    CondSwapInt32(swap, symtab->strsize))) {
+
+                goto finish;
+            }
+            if (!index->symtab) {
+                index->symtab = symtab;
+            }
+        } else if (cmd == LC_DYSYMTAB) {
+            if (cmd_size != sizeof(struct dysymtab_command)) {
+                goto finish;
+            }
+            if (!index->dysymtab) {
+                index->dysymtab = (struct dysymtab_command *)seek_lc;
+            }
+        } else if (cmd == LC_UUID) {
+            if (cmd_size < sizeof(struct uuid_command)) {
+                goto finish;
+            }
+            if (!index->uuid) {
+                index->uuid = ((struct uuid_command *)seek_lc)->uuid;
+            }
+        } else if (cmd == LC_SOURCE_VERSION) {
+            if (cmd_size < sizeof(struct source_version_command)) {
+                goto finish;
+            }
+            if (!index->has_source_version) {
+                index->has_source_version = 1;
+                index->source_version = CondSwapInt64(swap,
+                    ((struct source_version_command *)seek_lc)->version);
             }
         }
+
+        seek_lc = (struct load_command *)((char *)seek_lc + cmd_size);
     }
 
+    result = index;
+    index = NULL;
+
 finish:
+    macho_index_free(index);
     return result;
 }
 
+/******************************************************************************/
+
+void macho_index_free(macho_index * index)
+{
+    if (index) {
+        if (index->segments) free(index->segments);
+        if (index->sections) free(index->sections);
+        free(index);
+    }
+    return;
+}
+
+/******************************************************************************/
+
+void * macho_index_find_section_numbered(
+    const macho_index * index,
+    uint8_t             sect_num)
+{
+    if (!sect_num || sect_num > index->num_sections) {
+        return NULL;
+    }
+    return index->sections[sect_num - 1];
+}
+
+/******************************************************************************/
+
+struct load_command * macho_index_find_segment(
+    const macho_index * index,
+    const char        * segname)
+{
+    uint32_t i;
+
+   /* segname is at the same offset in both segment command structs.
+    */
+    for (i = 0; i < index->num_segments; i++) {
+        struct segment_command * seg_cmd =
+            (struct segment_command *)index->segments[i];
+
+        if (!strncmp(seg_cmd->segname, segname, sizeof(seg_cmd->segname))) {
+            return index->segments[i];
+        }
+    }
+    return NULL;
+}
+
+/******************************************************************************/
+
+void * macho_index_find_section(
+    const macho_index * index,
+    const char        * segname,
+    const char        * sectname)
+{
+    struct load_command * seg_cmd = NULL;
+    char                * sect    = NULL;
+    uint32_t              num_sects;
+    uint32_t              sect_size;
+    uint32_t              i;
+
+    seg_cmd = macho_index_find_segment(index, segname);
+    if (!seg_cmd) {
+        return NULL;
+    }
+
+    if (index->sixtyfourbit) {
+        num_sects = CondSwapInt32(index->swap,
+            ((struct segment_command_64 *)seg_cmd)->nsects);
+        sect = (char *)seg_cmd + sizeof(struct segment_command_64);
+        sect_size = sizeof(struct section_64);
+    } else {
+        num_sects = CondSwapInt32(index->swap,
+            ((struct segment_command *)seg_cmd)->nsects);
+        sect = (char *)seg_cmd + sizeof(struct segment_command);
+        sect_size = sizeof(struct section);
+    }
+
+   /* sectname is at the same offset in both section structs.
+    */
+    for (i = 0; i < num_sects; i++, sect += sect_size) {
+        if (!strncmp(((struct section *)sect)->sectname, sectname,
+            sizeof(((struct section *)sect)->sectname))) {
+
+            return sect;
+        }
+    }
+    return NULL;
+}
+
 /*******************************************************************************
 *
 *******************************************************************************/
@@ -601,9 +967,6 @@ macho_seek_result macho_find_source_version(
 /*******************************************************************************
 *
 *******************************************************************************/
-#define CMDSIZE_MULT_32  (4)
-#define CMDSIZE_MULT_64  (8)
-
 macho_seek_result macho_scan_load_commands(
     const void        * file_start,
     const void        * file_end,
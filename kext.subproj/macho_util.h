@@ -118,6 +118,111 @@ macho_seek_result macho_find_symbol(
           uint8_t       * nlist_type,
     const void         ** symbol_address);
 
+/*!
+ * @typedef macho_index
+ * @abstract The load commands of a mapped Mach-O file, parsed once.
+ * @discussion
+ *        A macho_index is filled in by macho_index_create with a single pass
+ *        over a file's load commands. All pointers refer into the mapped file,
+ *        which must stay mapped at the same address while the index is used.
+ *        Load command fields are not swapped; check swap before reading them.
+ *        Every load command, segment, section list, and the symbol and string
+ *        tables have been bounds-checked against the file.
+ *        macho_find_symbol uses one internally. The other macho_find_*
+ *        functions each need a single load command, which they find in one
+ *        scan without allocating, so they don't.
+ * @field file_start The start of the mapped file the index describes.
+ * @field file_end The end of the mapped file the index describes.
+ * @field swap Nonzero if the file's byte order is opposite the host's.
+ * @field sixtyfourbit Nonzero for a 64-bit file; segments and sections are then
+ *        segment_command_64 and section_64 structs.
+ * @field num_segments The number of entries in segments.
+ * @field segments The LC_SEGMENT or LC_SEGMENT_64 commands, in file order.
+ * @field num_sections The number of entries in sections.
+ * @field sections Every section struct in file order, so that
+ *        sections[n - 1] is section number n.
+ * @field symtab The LC_SYMTAB command, or NULL.
+ * @field dysymtab The LC_DYSYMTAB command, or NULL.
+ * @field uuid The 16 UUID bytes, or NULL.
+ * @field has_source_version Nonzero if the file has an LC_SOURCE_VERSION.
+ * @field source_version The (swapped) version from LC_SOURCE_VERSION.
+ * @field linkedit The __LINKEDIT segment command, or NULL.
+ * @field linkedit_fileoff The (swapped) file offset of __LINKEDIT.
+ * @field linkedit_filesize The (swapped) file size of __LINKEDIT.
+ */
+typedef struct macho_index {
+    const void               * file_start;
+    const void               * file_end;
+    uint8_t                    swap;
+    uint8_t                    sixtyfourbit;
+
+    uint32_t                   num_segments;
+    struct load_command     ** segments;
+    uint32_t                   num_sections;
+    void                    ** sections;
+
+    struct symtab_command    * symtab;
+    struct dysymtab_command  * dysymtab;
+    const uint8_t            * uuid;
+    uint8_t                    has_source_version;
+    uint64_t                   source_version;
+
+    struct load_command      * linkedit;
+    uint64_t                   linkedit_fileoff;
+    uint64_t                   linkedit_filesize;
+} macho_index;
+
+/*!
+ * @function macho_index_create
+ * @abstract Parses the load commands of a mapped Mach-O file.
+ * @param file_start A pointer to the beginning of the mapped Mach-O file.
+ * @param file_end A pointer to the end of the mapped Mach-O file.
+ * @result Returns a new index, or NULL if the file is malformed or memory
+ *         can't be allocated. Free it with macho_index_free.
+ */
+macho_index * macho_index_create(
+    const void * file_start,
+    const void * file_end);
+
+/*!
+ * @function macho_index_free
+ * @abstract Frees an index created with macho_index_create.
+ * @param index The index to free; may be NULL.
+ */
+void macho_index_free(macho_index * index);
+
+/*!
+ * @function macho_index_find_section_numbered
+ * @abstract Looks up a section by its ordinal number, starting with 1.
+ * @result See macho_find_section_numbered.
+ */
+// cast to (struct section[_64] *)
+void * macho_index_find_section_numbered(
+    const macho_index * index,
+    uint8_t             sect_num);
+
+/*!
+ * @function macho_index_find_segment
+ * @abstract Looks up a segment command by name.
+ * @result Returns the first segment command named segname, or NULL.
+ */
+// cast to (struct segment_command[_64] *)
+struct load_command * macho_index_find_segment(
+    const macho_index * index,
+    const char        * segname);
+
+/*!
+ * @function macho_index_find_section
+ * @abstract Looks up a section by segment and section name.
+ * @result Returns the named section within the first segment named segname,
+ *         or NULL.
+ */
+// cast to (struct section[_64] *)
+void * macho_index_find_section(
+    const macho_index * index,
+    const char        * segname,
+    const char        * sectname);
+
 /*!
  * @function macho_find_symtab
  * @abstract Finds a mapped Mach-O file's symbol table.